@@ -0,0 +1,133 @@
+#include "benchmark.h"
+#include "quantum.h"
+#include "kernels.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+using namespace std;
+
+//applies a layer of H on every qubit and a ladder of CNOTs, repeated until enough time has passed.
+//returns seconds per gate.
+static double time_gates(Registry& registry) {
+	const Gate h(Qubit(1, 1), Qubit(1, -1));
+	const Gate x(Qubit(0, 1), Qubit(1, 0));
+	const CGate cx(x);
+
+	unsigned int gates = 0;
+	auto start = chrono::steady_clock::now();
+	double elapsed = 0;
+	while (elapsed < 1) {
+		for (unsigned int q = 0; q < registry.size(); q++) GateInstruction(h, q)(registry);
+		for (unsigned int q = 0; q + 1 < registry.size(); q++) CGateInstruction(cx, q, q + 1)(registry);
+		gates += 2 * registry.size() - 1;
+		elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+	return elapsed / gates;
+}
+
+void benchmark_kernels(unsigned int size) {
+	const kernels::kernel_set<double>* sets[] = { &kernels::scalar, &kernels::avx2, &kernels::avx512 };
+	QRegistry registry(size);
+	double scalar = 0;
+
+	cout << "kernels  ms/gate  speedup" << endl;
+	for (const kernels::kernel_set<double>* set : sets) {
+		if (!kernels::select(set->name)) {
+			cout << left << setw(9) << set->name << "not supported by cpu" << endl;
+			continue;
+		}
+
+		double t = time_gates(registry);
+		if (set == &kernels::scalar) scalar = t;
+		cout << left << setw(9) << set->name << setw(9) << fixed << setprecision(3) << t * 1000
+			<< setprecision(2) << scalar / t << "x" << endl;
+	}
+}
+
+//applies layers of Ry rotations by varied angles, T gates and a ladder of CNOTs, a circuit whose amplitudes
+//spread over the whole state vector
+static void run_layers(Registry& registry, unsigned int layers) {
+	const complex<double> x[4] = { 0, 1, 1, 0 };
+	const complex<double> t[4] = { 1, 0, 0, polar(1.0, atan(1.0)) };
+
+	for (unsigned int l = 0; l < layers; l++) {
+		for (unsigned int q = 0; q < registry.size(); q++) {
+			double th = 0.1 + 0.37 * q + 0.23 * l;
+			const complex<double> ry[4] = { cos(th / 2), -sin(th / 2), sin(th / 2), cos(th / 2) };
+			GateInstruction(ry, q)(registry);
+			GateInstruction(t, q)(registry);
+		}
+		for (unsigned int q = 0; q + 1 < registry.size(); q++) CGateInstruction(x, q, q + 1)(registry);
+	}
+}
+
+void benchmark_precision(unsigned int size) {
+	QRegistry full(size);
+	QRegistryF single(size);
+
+	double t_full = time_gates(full);
+	double t_single = time_gates(single);
+
+	//fidelity |<full|single>|^2 of the states after the same circuit
+	const unsigned int layers = 20;
+	full.reset();
+	single.reset();
+	run_layers(full, layers);
+	run_layers(single, layers);
+	complex<double> overlap = 0;
+	for (size_t i = 0; i < full.length(); i++) overlap += conj(full.amplitude(i)) * single.amplitude(i);
+
+	cout << "precision  ms/gate  infidelity  speedup (infidelity after " << layers * (3 * size - 1) << " gates)" << endl;
+	cout << left << setw(11) << "double" << setw(9) << fixed << setprecision(3) << t_full * 1000
+		<< setw(12) << scientific << setprecision(2) << 0.0 << fixed << 1.0 << "x" << endl;
+	cout << left << setw(11) << "float" << setw(9) << fixed << setprecision(3) << t_single * 1000
+		<< setw(12) << scientific << setprecision(2) << 1 - norm(overlap) << fixed << t_full / t_single << "x" << endl;
+	cout << defaultfloat;
+}
+
+//applies one of the circuits compared by benchmark_layouts (0: H layer, 1: Rx layer, 2: CNOT ladder) until enough
+//time has passed. returns seconds per gate.
+static double time_circuit(Registry& registry, int circuit) {
+	const double s = sqrt(0.5);
+	const complex<double> h[4] = { s, s, s, -s };
+	const complex<double> rx[4] = { cos(0.15), complex<double>(0, -sin(0.15)), complex<double>(0, -sin(0.15)), cos(0.15) };
+	const complex<double> x[4] = { 0, 1, 1, 0 };
+
+	unsigned int gates = 0;
+	auto start = chrono::steady_clock::now();
+	double elapsed = 0;
+	while (elapsed < 1) {
+		for (unsigned int q = 0; q + (circuit == 2) < registry.size(); q++) {
+			if (circuit == 0) GateInstruction(h, q)(registry);
+			else if (circuit == 1) GateInstruction(rx, q)(registry);
+			else CGateInstruction(x, q, q + 1)(registry);
+			gates++;
+		}
+		elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+
+	return elapsed / gates;
+}
+
+template<typename T>
+static void compare_layouts(unsigned int size) {
+	const char* circuits[] = { "H", "Rx", "CNOT" };
+	BasicQRegistry<T> interleaved(size, Layout::interleaved);
+	BasicQRegistry<T> split(size, Layout::split);
+
+	cout << "circuit  interleaved  split    speedup (ms/gate)" << endl;
+	for (int c = 0; c < 3; c++) {
+		double t_interleaved = time_circuit(interleaved, c);
+		double t_split = time_circuit(split, c);
+		cout << left << setw(9) << circuits[c] << setw(13) << fixed << setprecision(3) << t_interleaved * 1000
+			<< setw(9) << t_split * 1000 << setprecision(2) << t_interleaved / t_split << "x" << endl;
+	}
+}
+
+void benchmark_layouts(unsigned int size) {
+	if (Registry::single_precision) compare_layouts<float>(size);
+	else compare_layouts<double>(size);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+//times gate application on a registry of given size for every kernel set the cpu supports,
+//and prints the time per gate and the speedup over the scalar kernels
+void benchmark_kernels(unsigned int size);
+
+//times gate application on registries of given size in double and single precision, and prints the time per gate
+//and the infidelity of the single precision state after a circuit of rotations and CNOTs
+void benchmark_precision(unsigned int size);
+
+//times layers of H, Rx and CNOT gates on registries of given size with interleaved and split amplitudes (in the
+//precision selected by Registry::single_precision), and prints the time per gate of each layout
+void benchmark_layouts(unsigned int size);
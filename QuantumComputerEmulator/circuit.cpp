@@ -0,0 +1,256 @@
+#include "circuit.h"
+#include "quantum.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char magic[4] = { 'M', 'Y', 'Q', 'C' };
+
+static const uint32_t version = 1;
+
+//kinds of records
+enum class record_kind : uint8_t { gate, cgate, mcgate, unitary, swap, measure, channel };
+
+//start of file
+struct circuit_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t size;
+	uint32_t reserved;
+	uint64_t count;
+	uint64_t reserved2;
+};
+
+//start of each record
+struct circuit_record {
+	uint8_t kind;
+	uint8_t reserved[3];
+	uint32_t qubits;
+	uint32_t values;
+	uint32_t reserved2;
+};
+
+//bytes of the qubits of a record, padded to a multiple of 8
+static size_t qubit_bytes(size_t qubits) {
+	return (qubits * sizeof(uint32_t) + 7) & ~(size_t)7;
+}
+
+//read-only view of a whole file mapped into memory (MapViewOfFile on windows, mmap elsewhere)
+class mapped_file {
+private:
+	const unsigned char* data_;
+	size_t size_;
+#ifdef _WIN32
+	HANDLE file_;
+	HANDLE mapping_;
+#endif
+
+public:
+	//throws runtime_error if the file cannot be opened or mapped
+	mapped_file(const string& filename) : data_(nullptr), size_(0) {
+#ifdef _WIN32
+		file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file_ == INVALID_HANDLE_VALUE) throw runtime_error("error: failed to load file " + filename);
+		LARGE_INTEGER size;
+		mapping_ = nullptr;
+		if (GetFileSizeEx(file_, &size) && size.QuadPart > 0) {
+			size_ = (size_t)size.QuadPart;
+			mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping_ != nullptr) data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+		}
+		if (data_ == nullptr) {
+			if (mapping_ != nullptr) CloseHandle(mapping_);
+			CloseHandle(file_);
+			throw runtime_error("error: failed to map file " + filename);
+		}
+#else
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) throw runtime_error("error: failed to load file " + filename);
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			size_ = (size_t)st.st_size;
+			void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				data_ = static_cast<const unsigned char*>(p);
+				madvise(p, size_, MADV_SEQUENTIAL);
+			}
+		}
+		//the mapping outlives the descriptor
+		close(fd);
+		if (data_ == nullptr) throw runtime_error("error: failed to map file " + filename);
+#endif
+	}
+
+	mapped_file(const mapped_file&) = delete;
+
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	~mapped_file() {
+#ifdef _WIN32
+		UnmapViewOfFile(data_);
+		CloseHandle(mapping_);
+		CloseHandle(file_);
+#else
+		munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+	}
+
+	const unsigned char* data() const { return data_; }
+
+	size_t size() const { return size_; }
+};
+
+//writes a record of given kind, qubits and values to out
+static void write(ofstream& out, record_kind k, const vector<unsigned int>& qubits, const complex<double>* values, size_t count) {
+	circuit_record r = {};
+	r.kind = (uint8_t)k;
+	r.qubits = (uint32_t)qubits.size();
+	r.values = (uint32_t)count;
+	out.write(reinterpret_cast<const char*>(&r), sizeof(r));
+
+	vector<uint32_t> q(qubit_bytes(qubits.size()) / sizeof(uint32_t), 0);
+	copy(qubits.begin(), qubits.end(), q.begin());
+	out.write(reinterpret_cast<const char*>(q.data()), q.size() * sizeof(uint32_t));
+	out.write(reinterpret_cast<const char*>(values), count * sizeof(complex<double>));
+}
+
+bool circuit::compiled(const string& filename) {
+	ifstream in(filename, ios::binary);
+	char m[sizeof(magic)];
+	return in.read(m, sizeof(m)) && memcmp(m, magic, sizeof(magic)) == 0;
+}
+
+void circuit::save(const Routine& routine, const string& filename) {
+	ofstream out(filename, ios::binary | ios::trunc);
+	if (out.fail()) throw runtime_error("error: failed to write file " + filename);
+
+	circuit_header h = {};
+	memcpy(h.magic, magic, sizeof(magic));
+	h.version = version;
+	h.size = routine.size();
+	h.count = routine.length();
+	out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+	routine.for_each([&out](const Instruction& i) {
+		vector<unsigned int> qubits = i.qubits();
+		const MultiControlledInstruction* mcg = dynamic_cast<const MultiControlledInstruction*>(&i);
+		const CGateInstruction* cg = dynamic_cast<const CGateInstruction*>(&i);
+		const ChannelInstruction* channel = dynamic_cast<const ChannelInstruction*>(&i);
+
+		if (mcg != nullptr) write(out, record_kind::mcgate, qubits, mcg->gate(), 4);
+		else if (cg != nullptr) write(out, record_kind::cgate, qubits, cg->gate(), 4);
+		else if (channel != nullptr) write(out, record_kind::channel, qubits, channel->kraus().data(), channel->kraus().size());
+		else if (dynamic_cast<const MeasureInstruction*>(&i) != nullptr) write(out, record_kind::measure, qubits, nullptr, 0);
+		else if (dynamic_cast<const SwapInstruction*>(&i) != nullptr) write(out, record_kind::swap, qubits, nullptr, 0);
+		else {
+			//gates and unitaries are written as their matrices
+			size_t dim = (size_t)1 << qubits.size();
+			vector<complex<double>> m(dim * dim);
+			i.matrix(m.data());
+			write(out, (qubits.size() == 1) ? record_kind::gate : record_kind::unitary, qubits, m.data(), m.size());
+		}
+	});
+
+	if (out.fail()) throw runtime_error("error: failed to write file " + filename);
+}
+
+Routine* circuit::load(const string& filename) {
+	mapped_file file(filename);
+	const unsigned char* p = file.data();
+	const unsigned char* end = p + file.size();
+	const string corrupt = "error: " + filename + " is not a valid compiled circuit";
+
+	circuit_header h;
+	if (file.size() < sizeof(h)) throw runtime_error(corrupt);
+	memcpy(&h, p, sizeof(h));
+	p += sizeof(h);
+	if (memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != version || h.size < 2) throw runtime_error(corrupt);
+
+	unique_ptr<Routine> routine(new Routine(h.size));
+	vector<unsigned int> qubits, sorted;
+	vector<complex<double>> values;
+	for (uint64_t n = 0; n < h.count; n++) {
+		circuit_record r;
+		if ((size_t)(end - p) < sizeof(r)) throw runtime_error(corrupt);
+		memcpy(&r, p, sizeof(r));
+		p += sizeof(r);
+
+		size_t qbytes = qubit_bytes(r.qubits);
+		if (r.qubits == 0 || r.qubits > h.size || (size_t)(end - p) < qbytes) throw runtime_error(corrupt);
+		qubits.resize(r.qubits);
+		for (size_t j = 0; j < r.qubits; j++) {
+			uint32_t q;
+			memcpy(&q, p + j * sizeof(q), sizeof(q));
+			if (q >= h.size) throw runtime_error(corrupt);
+			qubits[j] = q;
+		}
+		p += qbytes;
+
+		//every kind acts on distinct qubits (the controls and target of a gate, the pairs of a swap)
+		sorted.assign(qubits.begin(), qubits.end());
+		sort(sorted.begin(), sorted.end());
+		if (adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) throw runtime_error(corrupt);
+
+		if ((size_t)(end - p) / sizeof(complex<double>) < r.values) throw runtime_error(corrupt);
+		values.resize(r.values);
+		memcpy(values.data(), p, r.values * sizeof(complex<double>));
+		p += r.values * sizeof(complex<double>);
+
+		//each kind has the number of qubits and values its instruction takes
+		Instruction* i = nullptr;
+		switch ((record_kind)r.kind) {
+		case record_kind::gate:
+			if (r.qubits == 1 && r.values == 4) i = new GateInstruction(values.data(), qubits[0]);
+			break;
+		case record_kind::cgate:
+			if (r.qubits == 2 && r.values == 4) i = new CGateInstruction(values.data(), qubits[0], qubits[1]);
+			break;
+		case record_kind::mcgate:
+			if (r.values == 4) {
+				unsigned int target = qubits.back();
+				qubits.pop_back();
+				i = new MultiControlledInstruction(qubits, target, values.data());
+			}
+			break;
+		case record_kind::unitary:
+			if (r.qubits <= Registry::max_unitary_qubits && r.values == ((size_t)1 << (2 * r.qubits))) {
+				i = new UnitaryInstruction(qubits, values);
+			}
+			break;
+		case record_kind::swap:
+			if (r.qubits % 2 == 0 && r.values == 0) {
+				vector<pair<unsigned int, unsigned int>> pairs;
+				for (size_t j = 0; j < qubits.size(); j += 2) pairs.emplace_back(qubits[j], qubits[j + 1]);
+				i = new SwapInstruction(pairs);
+			}
+			break;
+		case record_kind::measure:
+			if (r.qubits == 1 && r.values == 0) i = new MeasureInstruction(qubits[0]);
+			break;
+		case record_kind::channel:
+			if (r.qubits == 1 && r.values > 0 && r.values % 4 == 0) i = new ChannelInstruction(qubits[0], values);
+			break;
+		}
+		if (i == nullptr) throw runtime_error(corrupt);
+		routine->append(i);
+	}
+	if (p != end) throw runtime_error(corrupt);
+
+	routine->mark_optimized();
+	return routine.release();
+}
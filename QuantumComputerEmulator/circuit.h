@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+
+class Routine;
+
+//compiled circuits: the instructions of an optimized routine (user defined gates expanded, gates cancelled and
+//fused) in a binary file, so that running a large generated circuit again does not read, parse and optimize its
+//text. the file is mapped into memory and its records turned into instructions in a single sweep.
+//
+//the file (in the byte order of the machine) is a header
+//	char magic[4] ("MYQC"), uint32 version, uint32 size (qubits), uint32 0, uint64 count (records), uint64 0
+//followed by count records, each
+//	uint8 kind, uint8 0, uint16 0, uint32 qubits, uint32 values, uint32 0
+//	uint32 qubit[qubits], padded with 0 to a multiple of 8 bytes
+//	double value[2 * values] (real and imaginary parts)
+//where kind is one of
+//	gate		qubit: target, values: 2x2 matrix (row-major)
+//	cgate		qubits: control, target, values: 2x2 matrix applied to target
+//	mcgate		qubits: controls..., target, values: 2x2 matrix applied to target
+//	unitary		qubits: k qubits, values: 2^k x 2^k matrix, qubit j being bit j of its indices
+//	swap		qubits: the qubits of each pair in turn, no values
+//	measure		qubit: measured qubit, no values
+//	channel		qubit: target, values: 2x2 Kraus operators, concatenated
+namespace circuit {
+	//true if file begins as a compiled circuit
+	bool compiled(const std::string& filename);
+
+	//writes the instructions of routine, as they are, to file. throws runtime_error if the file cannot be written.
+	void save(const Routine& routine, const std::string& filename);
+
+	//new routine of the instructions of compiled circuit file, marked optimized. throws runtime_error if the file
+	//cannot be mapped or is not a valid compiled circuit.
+	Routine* load(const std::string& filename);
+}
@@ -0,0 +1,239 @@
+#include "cluster.h"
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+typedef SOCKET socket_t;
+static const socket_t no_socket = INVALID_SOCKET;
+static void close_socket(socket_t s) { closesocket(s); }
+static const int send_flags = 0;
+#else
+typedef int socket_t;
+static const socket_t no_socket = -1;
+static void close_socket(socket_t s) { close(s); }
+//a closed connection fails the call instead of raising SIGPIPE
+static const int send_flags = MSG_NOSIGNAL;
+#endif
+
+static unsigned int rank_ = 0;
+
+static unsigned int ranks_ = 1;
+
+//peers[r] is the connection to rank r
+static vector<socket_t> peers;
+
+//processes started by spawn
+#ifndef _WIN32
+static vector<pid_t> children;
+#endif
+
+//pieces sent and received by a single call, within the limits of send and recv on all platforms
+static const size_t max_piece = (size_t)1 << 30;
+
+static void send_all(socket_t s, const void* data, size_t bytes) {
+	const char* p = static_cast<const char*>(data);
+	while (bytes > 0) {
+		int sent = send(s, p, (int)min(bytes, max_piece), send_flags);
+		if (sent <= 0) throw runtime_error("error: lost connection to another rank");
+		p += sent;
+		bytes -= sent;
+	}
+}
+
+static void recv_all(socket_t s, void* data, size_t bytes) {
+	char* p = static_cast<char*>(data);
+	while (bytes > 0) {
+		int received = recv(s, p, (int)min(bytes, max_piece), 0);
+		if (received <= 0) throw runtime_error("error: lost connection to another rank");
+		p += received;
+		bytes -= received;
+	}
+}
+
+unsigned int cluster::spawn(unsigned int ranks) {
+#ifdef _WIN32
+	if (ranks > 1) throw runtime_error("error: start each rank with --rank on this platform");
+	return 0;
+#else
+	for (unsigned int r = 1; r < ranks; r++) {
+		pid_t pid = fork();
+		if (pid < 0) throw runtime_error("error: failed to start rank " + to_string(r));
+		if (pid == 0) {
+			children.clear();
+			return r;
+		}
+		children.push_back(pid);
+	}
+	return 0;
+#endif
+}
+
+void cluster::connect(unsigned int rank, unsigned int ranks, const vector<string>& hosts, unsigned short port) {
+	if (rank >= ranks) throw runtime_error("error: rank must be below number of ranks");
+	rank_ = rank;
+	ranks_ = ranks;
+	peers.assign(ranks, no_socket);
+	if (ranks == 1) return;
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) throw runtime_error("error: failed to start winsock");
+#endif
+
+	//listen before connecting, so that higher ranks can connect while this rank connects to lower ones
+	socket_t listener = socket(AF_INET, SOCK_STREAM, 0);
+	int yes = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&yes), sizeof(yes));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((unsigned short)(port + rank));
+	if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, ranks) != 0) {
+		close_socket(listener);
+		throw runtime_error("error: failed to listen on port " + to_string(port + rank));
+	}
+
+	//connect to lower ranks (retrying while they start), then accept higher ranks, which introduce themselves
+	for (unsigned int r = 0; r < rank; r++) {
+		const string& host = hosts.empty() ? string("127.0.0.1") : hosts[r % hosts.size()];
+		addrinfo hints, *info = nullptr;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		if (getaddrinfo(host.c_str(), to_string(port + r).c_str(), &hints, &info) != 0) {
+			close_socket(listener);
+			throw runtime_error("error: unknown host " + host);
+		}
+
+		socket_t s = no_socket;
+		for (int attempt = 0; attempt < 600 && s == no_socket; attempt++) {
+			s = socket(AF_INET, SOCK_STREAM, 0);
+			if (::connect(s, info->ai_addr, (int)info->ai_addrlen) != 0) {
+				close_socket(s);
+				s = no_socket;
+				this_thread::sleep_for(chrono::milliseconds(50));
+			}
+		}
+		freeaddrinfo(info);
+		if (s == no_socket) {
+			close_socket(listener);
+			throw runtime_error("error: failed to connect to rank " + to_string(r));
+		}
+
+		uint32_t me = rank;
+		send_all(s, &me, sizeof(me));
+		peers[r] = s;
+	}
+	for (unsigned int r = rank + 1; r < ranks; r++) {
+		socket_t s = accept(listener, nullptr, nullptr);
+		if (s == no_socket) {
+			close_socket(listener);
+			throw runtime_error("error: failed to accept connection of another rank");
+		}
+		uint32_t other;
+		recv_all(s, &other, sizeof(other));
+		if (other <= rank || other >= ranks || peers[other] != no_socket) throw runtime_error("error: unexpected rank " + to_string(other));
+		peers[other] = s;
+	}
+	close_socket(listener);
+
+	//exchanges are sent as soon as they are written
+	for (socket_t s : peers) {
+		if (s != no_socket) setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&yes), sizeof(yes));
+	}
+}
+
+void cluster::disconnect() {
+	for (socket_t s : peers) if (s != no_socket) close_socket(s);
+	peers.clear();
+#ifdef _WIN32
+	if (ranks_ > 1) WSACleanup();
+#else
+	for (pid_t pid : children) waitpid(pid, nullptr, 0);
+	children.clear();
+#endif
+	rank_ = 0;
+	ranks_ = 1;
+}
+
+unsigned int cluster::rank() {
+	return rank_;
+}
+
+unsigned int cluster::ranks() {
+	return ranks_;
+}
+
+void cluster::exchange(unsigned int partner, const void* send, void* recv, size_t bytes) {
+	//both sides send and receive at once, so neither waits for the other to drain its socket
+	exception_ptr error;
+	thread sender([&]() {
+		try {
+			send_all(peers[partner], send, bytes);
+		}
+		catch (...) {
+			error = current_exception();
+		}
+	});
+	try {
+		recv_all(peers[partner], recv, bytes);
+	}
+	catch (...) {
+		sender.join();
+		throw;
+	}
+	sender.join();
+	if (error) rethrow_exception(error);
+}
+
+void cluster::broadcast(void* data, size_t bytes, unsigned int root) {
+	if (rank_ != root) {
+		recv_all(peers[root], data, bytes);
+		return;
+	}
+	for (unsigned int r = 0; r < ranks_; r++) if (r != root) send_all(peers[r], data, bytes);
+}
+
+vector<double> cluster::all_gather(double x) {
+	vector<double> values(ranks_);
+	values[rank_] = x;
+	//rank 0 collects the values, and sends all of them back
+	if (rank_ == 0) {
+		for (unsigned int r = 1; r < ranks_; r++) recv_all(peers[r], &values[r], sizeof(double));
+	}
+	else send_all(peers[0], &x, sizeof(double));
+	broadcast(values.data(), ranks_ * sizeof(double));
+	return values;
+}
+
+vector<vector<uint64_t>> cluster::all_gather(const vector<uint64_t>& data) {
+	vector<double> sizes = all_gather((double)data.size());
+	vector<vector<uint64_t>> all(ranks_);
+	for (unsigned int r = 0; r < ranks_; r++) all[r].resize((size_t)sizes[r]);
+	all[rank_] = data;
+
+	if (rank_ == 0) {
+		for (unsigned int r = 1; r < ranks_; r++) recv_all(peers[r], all[r].data(), all[r].size() * sizeof(uint64_t));
+	}
+	else send_all(peers[0], data.data(), data.size() * sizeof(uint64_t));
+	for (unsigned int r = 0; r < ranks_; r++) broadcast(all[r].data(), all[r].size() * sizeof(uint64_t));
+	return all;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//processes (ranks) working on one state vector, connected pairwise by tcp sockets. every rank runs the same
+//program, so the collective operations below must be called by all ranks in the same order.
+namespace cluster {
+	//starts ranks - 1 more processes on this machine (posix only), which continue from the call with their own
+	//rank. returns rank of the calling process (0 for the process that started the others).
+	unsigned int spawn(unsigned int ranks);
+
+	//connects process of given rank to the other ranks. rank r listens on port + r of hosts[r % hosts.size()].
+	//throws runtime_error if the connections cannot be made.
+	void connect(unsigned int rank, unsigned int ranks, const std::vector<std::string>& hosts, unsigned short port);
+
+	//closes the connections, and waits for spawned processes to exit
+	void disconnect();
+
+	unsigned int rank();
+
+	//number of ranks, 1 if not connected
+	unsigned int ranks();
+
+	//sends bytes of send to partner while receiving the same number of bytes of partner into recv
+	void exchange(unsigned int partner, const void* send, void* recv, size_t bytes);
+
+	//copies bytes of data of rank root to data of all other ranks
+	void broadcast(void* data, size_t bytes, unsigned int root = 0);
+
+	//values of x of all ranks, by rank
+	std::vector<double> all_gather(double x);
+
+	//data of all ranks, by rank
+	std::vector<std::vector<uint64_t>> all_gather(const std::vector<uint64_t>& data);
+}
@@ -0,0 +1,275 @@
+#include "density.h"
+#include "parallel.h"
+#include "random.h"
+#include <complex>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+//spreads the 32 low bits of x to the even bits of the result
+static inline size_t spread(size_t x) {
+	uint64_t y = x & 0xFFFFFFFF;
+	y = (y | (y << 16)) & 0x0000FFFF0000FFFF;
+	y = (y | (y << 8)) & 0x00FF00FF00FF00FF;
+	y = (y | (y << 4)) & 0x0F0F0F0F0F0F0F0F;
+	y = (y | (y << 2)) & 0x3333333333333333;
+	y = (y | (y << 1)) & 0x5555555555555555;
+	return (size_t)y;
+}
+
+//4x4 matrix acting on the (row, column) bits of a qubit of a density matrix (bit 0 of indices being the row bit)
+//that applies 2x2 matrix k as k rho k^H, added to s
+static void add_superoperator(const complex<double>* k, complex<double>* s) {
+	for (int r = 0; r < 2; r++) {
+		for (int c = 0; c < 2; c++) {
+			for (int r0 = 0; r0 < 2; r0++) {
+				for (int c0 = 0; c0 < 2; c0++) s[(r | c << 1) * 4 + (r0 | c0 << 1)] += k[r * 2 + r0] * conj(k[c * 2 + c0]);
+			}
+		}
+	}
+}
+
+template<typename T>
+size_t DensityRegistry<T>::index(size_t r, size_t c) {
+	return spread(r) | (spread(c) << 1);
+}
+
+template<typename T>
+DensityRegistry<T>::DensityRegistry(unsigned int size, Layout layout) : Registry(size), rho_(2 * size, layout) {}
+
+template<typename T>
+void DensityRegistry<T>::reset() {
+	rho_.reset();
+}
+
+template<typename T>
+vector<double> DensityRegistry<T>::diagonal() const {
+	vector<double> p((size_t)1 << size_);
+	parallel_for(p.size(), [this, &p](size_t begin, size_t end) {
+		for (size_t k = begin; k < end; k++) p[k] = max(0.0, rho_.amplitude(index(k, k)).real());
+	});
+	return p;
+}
+
+template<typename T>
+complex<double> DensityRegistry<T>::amplitude(size_t i) const {
+	return sqrt(max(0.0, rho_.amplitude(index(i, i)).real()));
+}
+
+template<typename T>
+bool DensityRegistry<T>::measure(unsigned int i) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+
+	size_t mask = (size_t)1 << i;
+	vector<double> p = diagonal();
+	double p1 = 0;
+	for (size_t k = 0; k < p.size(); k++) if (k & mask) p1 += p[k];
+
+	bool value = p1 >= 1 || rng::local().uniform() < p1;
+
+	//elements of the other value in row or column are zeroed, the others renormalized
+	complex<double> s[16] = {};
+	size_t v = value ? 1 : 0;
+	s[(v | v << 1) * 5] = 1 / (value ? p1 : 1 - p1);
+	rho_.apply_unitary({ 2 * i, 2 * i + 1 }, s);
+
+	return value;
+}
+
+template<typename T>
+uint64_t DensityRegistry<T>::measure_all() {
+	vector<double> p = diagonal();
+	for (size_t k = 1; k < p.size(); k++) p[k] += p[k - 1];
+
+	double r = rng::local().uniform() * p.back();
+	uint64_t val = upper_bound(p.begin(), p.end() - 1, r) - p.begin();
+
+	rho_.assign({ { index(val, val), complex<T>(1) } });
+	return val;
+}
+
+template<typename T>
+map<uint64_t, size_t> DensityRegistry<T>::sample(size_t shots) const {
+	vector<double> p = diagonal();
+	for (size_t k = 1; k < p.size(); k++) p[k] += p[k - 1];
+
+	rng::generator& generator = rng::local();
+	vector<double> random(shots);
+	for (double& r : random) r = generator.uniform() * p.back();
+	sort(random.begin(), random.end());
+
+	//sorted samples are found in a single sweep of the cumulative probabilities
+	map<uint64_t, size_t> counts;
+	size_t k = 0;
+	for (double r : random) {
+		while (k + 1 < p.size() && p[k] <= r) k++;
+		counts[k]++;
+	}
+
+	return counts;
+}
+
+template<typename T>
+void DensityRegistry<T>::apply(unsigned int target, const complex<double>* m) {
+	if (target >= size_) throw runtime_error("registry not large enough");
+
+	//as two passes of the 2x2 kernels, cheaper than one of a 4x4 matrix
+	complex<double> mc[4];
+	for (int j = 0; j < 4; j++) mc[j] = conj(m[j]);
+	rho_.apply(2 * target, m);
+	rho_.apply(2 * target + 1, mc);
+}
+
+template<typename T>
+void DensityRegistry<T>::apply_controlled(unsigned int control, unsigned int target, const complex<double>* m) {
+	if (control >= size_ || target >= size_) throw runtime_error("registry not large enough");
+
+	complex<double> mc[4];
+	for (int j = 0; j < 4; j++) mc[j] = conj(m[j]);
+	rho_.apply_controlled(2 * control, 2 * target, m);
+	rho_.apply_controlled(2 * control + 1, 2 * target + 1, mc);
+}
+
+template<typename T>
+void DensityRegistry<T>::apply_multi_controlled(const vector<unsigned int>& controls, unsigned int target, const complex<double>* m) {
+	if (target >= size_) throw runtime_error("registry not large enough");
+
+	complex<double> mc[4];
+	for (int j = 0; j < 4; j++) mc[j] = conj(m[j]);
+	vector<unsigned int> rows, columns;
+	for (unsigned int c : controls) {
+		if (c >= size_) throw runtime_error("registry not large enough");
+		rows.push_back(2 * c);
+		columns.push_back(2 * c + 1);
+	}
+	rho_.apply_multi_controlled(rows, 2 * target, m);
+	rho_.apply_multi_controlled(columns, 2 * target + 1, mc);
+}
+
+template<typename T>
+void DensityRegistry<T>::apply_unitary(const vector<unsigned int>& qubits, const complex<double>* m) {
+	if (qubits.size() == 1) return apply(qubits[0], m);
+	for (unsigned int q : qubits) if (q >= size_) throw runtime_error("registry not large enough");
+
+	size_t dim = (size_t)1 << qubits.size();
+	vector<complex<double>> mc(m, m + dim * dim);
+	for (complex<double>& x : mc) x = conj(x);
+	vector<unsigned int> rows, columns;
+	for (unsigned int q : qubits) {
+		rows.push_back(2 * q);
+		columns.push_back(2 * q + 1);
+	}
+	rho_.apply_unitary(rows, m);
+	rho_.apply_unitary(columns, mc.data());
+}
+
+template<typename T>
+void DensityRegistry<T>::swap_qubits(const vector<pair<unsigned int, unsigned int>>& pairs) {
+	vector<pair<unsigned int, unsigned int>> bits;
+	for (const pair<unsigned int, unsigned int>& p : pairs) {
+		bits.emplace_back(2 * p.first, 2 * p.second);
+		bits.emplace_back(2 * p.first + 1, 2 * p.second + 1);
+	}
+	rho_.swap_qubits(bits);
+}
+
+template<typename T>
+void DensityRegistry<T>::apply_channel(unsigned int target, const vector<complex<double>>& kraus) {
+	if (target >= size_) throw runtime_error("registry not large enough");
+
+	complex<double> s[16] = {};
+	for (size_t k = 0; k < kraus.size(); k += 4) add_superoperator(&kraus[k], s);
+	rho_.apply_unitary({ 2 * target, 2 * target + 1 }, s);
+}
+
+template<typename T>
+void DensityRegistry<T>::reduced(unsigned int i, complex<double>* rho) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+
+	//trace over the other qubits: elements whose rows and columns agree on them
+	size_t mask = (size_t)1 << i;
+	fill(rho, rho + 4, complex<double>(0));
+	for (size_t k = 0; k < ((size_t)1 << size_); k++) {
+		if (k & mask) continue;
+		for (size_t r = 0; r < 2; r++) {
+			for (size_t c = 0; c < 2; c++) rho[r * 2 + c] += element(k | (r ? mask : 0), k | (c ? mask : 0));
+		}
+	}
+}
+
+template<typename T>
+double DensityRegistry<T>::pauli_expectation(uint64_t flip, uint64_t sign, unsigned int ys) const {
+	//the product takes column i ^ flip of row i to the diagonal, so element (i, i ^ flip) plays a conj(b) of a pure state
+	return parallel_sum((size_t)1 << size_, [this, flip, sign, ys](size_t begin, size_t end) {
+		double sum = 0;
+		for (size_t i = begin; i < end; i++) sum += pauli_term(i, sign, ys, element(i, i ^ flip), 1);
+		return sum;
+	});
+}
+
+template<typename T>
+void DensityRegistry<T>::superoperator(const Instruction& i, vector<unique_ptr<Instruction>>& out) const {
+	//multi-controlled gates keep their kernel, without a dense matrix of all their qubits
+	const MultiControlledInstruction* mcg = dynamic_cast<const MultiControlledInstruction*>(&i);
+	if (mcg != nullptr) {
+		complex<double> gc[4];
+		for (int j = 0; j < 4; j++) gc[j] = conj(mcg->gate()[j]);
+		vector<unsigned int> rows, columns;
+		for (unsigned int c : mcg->controls()) {
+			rows.push_back(2 * c);
+			columns.push_back(2 * c + 1);
+		}
+		out.emplace_back(new MultiControlledInstruction(rows, 2 * mcg->target(), mcg->gate()));
+		out.emplace_back(new MultiControlledInstruction(columns, 2 * mcg->target() + 1, gc));
+		return;
+	}
+
+	vector<unsigned int> qubits = i.qubits();
+	size_t dim = (size_t)1 << qubits.size();
+	vector<complex<double>> m(dim * dim);
+	i.matrix(m.data());
+
+	//gates and controlled gates keep the kernels of their kind
+	if (qubits.size() == 1) {
+		complex<double> mc[4];
+		for (int j = 0; j < 4; j++) mc[j] = conj(m[j]);
+		out.emplace_back(new GateInstruction(m.data(), 2 * qubits[0]));
+		out.emplace_back(new GateInstruction(mc, 2 * qubits[0] + 1));
+		return;
+	}
+	if (dynamic_cast<const CGateInstruction*>(&i) != nullptr) {
+		complex<double> g[4], gc[4];
+		for (int r = 0; r < 2; r++) {
+			for (int c = 0; c < 2; c++) {
+				g[r * 2 + c] = m[(1 | r << 1) * 4 + (1 | c << 1)];
+				gc[r * 2 + c] = conj(g[r * 2 + c]);
+			}
+		}
+		out.emplace_back(new CGateInstruction(g, 2 * qubits[0], 2 * qubits[1]));
+		out.emplace_back(new CGateInstruction(gc, 2 * qubits[0] + 1, 2 * qubits[1] + 1));
+		return;
+	}
+
+	vector<unsigned int> rows, columns;
+	for (unsigned int q : qubits) {
+		rows.push_back(2 * q);
+		columns.push_back(2 * q + 1);
+	}
+	out.emplace_back(new UnitaryInstruction(rows, m));
+	for (complex<double>& x : m) x = conj(x);
+	out.emplace_back(new UnitaryInstruction(columns, m));
+}
+
+template<typename T>
+void DensityRegistry<T>::apply_local(const vector<unique_ptr<Instruction>>& instructions, unsigned int local) {
+	//the row and column bits of local qubits are the low 2 local qubits of rho_
+	vector<unique_ptr<Instruction>> super;
+	for (const unique_ptr<Instruction>& i : instructions) superoperator(*i, super);
+	rho_.apply_local(super, 2 * local);
+}
+
+template class DensityRegistry<double>;
+
+template class DensityRegistry<float>;
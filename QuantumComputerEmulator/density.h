@@ -0,0 +1,65 @@
+#pragma once
+#include "quantum.h"
+
+//mixed state of a registry as its 2^size x 2^size density matrix rho, held as a state vector of 2 size qubits in
+//which qubit 2q is the row bit and qubit 2q + 1 the column bit of qubit q. a gate u acts as u on the row bits and
+//conj(u) on the column bits, and a noise channel as the sum of k (x) conj(k) over its Kraus operators k, so the
+//parallel kernels of state vectors apply both, and runs of gates on low qubits (touching low qubits of the vector)
+//are applied to cache-sized chunks as for state vectors. memory grows as 4^size.
+template<typename T>
+class DensityRegistry : public Registry {
+private:
+	BasicQRegistry<T> rho_;
+
+	//index in rho_ of element (r, c)
+	static size_t index(size_t r, size_t c);
+
+	//probabilities of the states (the diagonal of rho), computed in parallel
+	std::vector<double> diagonal() const;
+
+	//appends the instructions acting on rho_ that apply unitary instruction i to the density matrix to out
+	void superoperator(const Instruction& i, std::vector<std::unique_ptr<Instruction>>& out) const;
+
+public:
+	//constructs registry of given size in state |0...0><0...0|, with elements stored in given layout.
+	//throws memory_exception if the density matrix exceeds memory budget, bad_alloc if allocation fails.
+	DensityRegistry(unsigned int size, Layout layout = Layout::interleaved);
+
+	//element (r, c) of the density matrix
+	std::complex<double> element(size_t r, size_t c) const { return rho_.amplitude(index(r, c)); }
+
+	void reset() override;
+
+	//square root of the probability of state i (a mixed state has no amplitudes)
+	std::complex<double> amplitude(size_t i) const override;
+
+	bool measure(unsigned int i) override;
+
+	uint64_t measure_all() override;
+
+	std::map<uint64_t, size_t> sample(size_t shots) const override;
+
+	void apply(unsigned int target, const std::complex<double>* m) override;
+
+	void apply_controlled(unsigned int control, unsigned int target, const std::complex<double>* m) override;
+
+	void apply_multi_controlled(const std::vector<unsigned int>& controls, unsigned int target, const std::complex<double>* m) override;
+
+	void apply_unitary(const std::vector<unsigned int>& qubits, const std::complex<double>* m) override;
+
+	void swap_qubits(const std::vector<std::pair<unsigned int, unsigned int>>& pairs) override;
+
+	//applies the channel exactly: rho becomes the sum of k rho k^H over the Kraus operators k
+	void apply_channel(unsigned int target, const std::vector<std::complex<double>>& kraus) override;
+
+	void reduced(unsigned int i, std::complex<double>* rho) override;
+
+	//trace of rho times the Pauli product, summed over the rows in parallel
+	double pauli_expectation(uint64_t flip, uint64_t sign, unsigned int ys) const override;
+
+	bool mixed() const override { return true; }
+
+	unsigned int local_qubits() const override { return rho_.local_qubits() / 2; }
+
+	void apply_local(const std::vector<std::unique_ptr<Instruction>>& instructions, unsigned int local) override;
+};
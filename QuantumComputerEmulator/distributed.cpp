@@ -0,0 +1,324 @@
+#include "distributed.h"
+#include "cluster.h"
+#include "random.h"
+#include <complex>
+#include <cmath>
+#include <cfloat>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+//amplitudes sent to another rank at a time, bounding the buffers of an exchange
+static const size_t piece = (size_t)1 << 20;
+
+//number of global qubits for the ranks of the cluster
+static unsigned int global_qubits(unsigned int size) {
+	unsigned int ranks = cluster::ranks();
+	unsigned int k = 0;
+	while (((unsigned int)1 << k) < ranks) k++;
+	if (((unsigned int)1 << k) != ranks) throw runtime_error("error: number of ranks must be a power of 2");
+	if (size < k + Registry::max_unitary_qubits) throw runtime_error("error: registry too small for number of ranks");
+	return k;
+}
+
+bool distributable(unsigned int size) {
+	unsigned int k = 0;
+	while (((unsigned int)1 << k) < cluster::ranks()) k++;
+	return k > 0 && size >= k + Registry::max_unitary_qubits;
+}
+
+static unsigned int popcount(size_t mask) {
+	unsigned int count = 0;
+	for (; mask != 0; mask &= mask - 1) count++;
+	return count;
+}
+
+template<typename T>
+DistributedRegistry<T>::DistributedRegistry(unsigned int size, Layout layout)
+	: Registry(size), local_(size - global_qubits(size), layout), global_(size - local_.size()), rank_(cluster::rank()) {
+	if (rank_ != 0) local_.combine(0, 0, 0, local_.length(), nullptr, 0, 0);
+}
+
+template<typename T>
+double DistributedRegistry<T>::draw() {
+	double u = (cluster::rank() == 0) ? rng::local().uniform() : 0;
+	cluster::broadcast(&u, sizeof(u));
+	return u;
+}
+
+template<typename T>
+template<typename F>
+void DistributedRegistry<T>::exchange(unsigned int partner, size_t mask, size_t value, const F& f) {
+	size_t count = local_.length() >> popcount(mask);
+	vector<complex<T>> out(min(piece, count)), in(min(piece, count));
+
+	for (size_t first = 0; first < count; first += piece) {
+		size_t n = min(piece, count - first);
+		local_.export_amplitudes(mask, value, first, n, out.data());
+		cluster::exchange(partner, out.data(), in.data(), n * sizeof(complex<T>));
+		f(first, n, in.data());
+	}
+}
+
+template<typename T>
+void DistributedRegistry<T>::apply_global(unsigned int g, const complex<double>* m, size_t mask, size_t value) {
+	//the partner holds the states with the other value of the qubit. this rank holds states with value bit(g), and
+	//its new amplitudes are row bit(g) of m applied to (own, partner's) or (partner's, own).
+	bool b = bit(g);
+	complex<double> own = m[b ? 3 : 0];
+	complex<double> other = m[b ? 2 : 1];
+
+	//both ranks of a pair must take the same branch
+	if (m[1] == 0.0 && m[2] == 0.0) {
+		local_.combine(mask, value, 0, local_.length() >> popcount(mask), nullptr, own, 0);
+		return;
+	}
+	exchange(rank_ ^ (1u << g), mask, value, [&](size_t first, size_t count, const complex<T>* received) {
+		local_.combine(mask, value, first, count, received, own, other);
+	});
+}
+
+template<typename T>
+void DistributedRegistry<T>::reset() {
+	local_.reset();
+	if (rank_ != 0) local_.combine(0, 0, 0, local_.length(), nullptr, 0, 0);
+}
+
+template<typename T>
+complex<double> DistributedRegistry<T>::amplitude(size_t i) const {
+	unsigned int owner = (unsigned int)(i >> local_size());
+	complex<double> a = (owner == rank_) ? local_.amplitude(i & (local_.length() - 1)) : 0;
+	cluster::broadcast(&a, sizeof(a), owner);
+	return a;
+}
+
+template<typename T>
+bool DistributedRegistry<T>::measure(unsigned int i) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+
+	//probabilities are summed in rank order, so that all ranks get the same p1 and value
+	unsigned int l = local_size();
+	if (i < l) {
+		vector<double> p = cluster::all_gather(local_.probability(i));
+		double p1 = accumulate(p.begin(), p.end(), 0.0);
+		bool value = p1 >= 1 || draw() < p1;
+		local_.collapse(i, value, value ? p1 : 1 - p1);
+		return value;
+	}
+
+	unsigned int g = i - l;
+	vector<double> totals = cluster::all_gather(local_.total());
+	double p1 = 0;
+	for (unsigned int r = 0; r < totals.size(); r++) if ((r >> g) & 1) p1 += totals[r];
+	bool value = p1 >= 1 || draw() < p1;
+
+	//ranks of the other value are zeroed, the others renormalized
+	double scale = (bit(g) == value) ? 1 / sqrt(value ? p1 : 1 - p1) : 0;
+	local_.combine(0, 0, 0, local_.length(), nullptr, scale, 0);
+	return value;
+}
+
+//rank whose states contain x, cumulating totals in rank order. prefix is set to the total of the ranks below it.
+static unsigned int owner(const vector<double>& totals, double x, double& prefix) {
+	unsigned int last = 0;
+	prefix = 0;
+	double below = 0;
+	for (unsigned int r = 0; r < totals.size(); r++) {
+		if (totals[r] > 0) {
+			if (x < below + totals[r]) {
+				prefix = below;
+				return r;
+			}
+			last = r;
+			prefix = below;
+		}
+		below += totals[r];
+	}
+	//x rounded up to the sum of all totals falls in the last rank with some probability
+	return last;
+}
+
+template<typename T>
+uint64_t DistributedRegistry<T>::measure_all() {
+	vector<double> totals = cluster::all_gather(local_.total());
+	double x = draw() * accumulate(totals.begin(), totals.end(), 0.0);
+	double prefix;
+	unsigned int r = owner(totals, x, prefix);
+
+	uint64_t value = 0;
+	if (rank_ == r) value = local_.measure_all(min((x - prefix) / totals[r], 1.0 - DBL_EPSILON));
+	else local_.combine(0, 0, 0, local_.length(), nullptr, 0, 0);
+	cluster::broadcast(&value, sizeof(value), r);
+
+	return ((uint64_t)r << local_size()) | value;
+}
+
+template<typename T>
+map<uint64_t, size_t> DistributedRegistry<T>::sample(size_t shots) const {
+	vector<double> totals = cluster::all_gather(local_.total());
+	double sum = accumulate(totals.begin(), totals.end(), 0.0);
+
+	vector<double> u(shots);
+	if (rank_ == 0) {
+		rng::generator& generator = rng::local();
+		for (double& x : u) x = generator.uniform();
+		sort(u.begin(), u.end());
+	}
+	cluster::broadcast(u.data(), shots * sizeof(double));
+
+	//each rank samples the shots falling in its states, then all counts are gathered
+	vector<double> own;
+	for (double x : u) {
+		double prefix;
+		if (owner(totals, x * sum, prefix) == rank_) own.push_back(min((x * sum - prefix) / totals[rank_], 1.0 - DBL_EPSILON));
+	}
+
+	vector<uint64_t> counts;
+	if (!own.empty()) {
+		for (const pair<const uint64_t, size_t>& c : local_.sample(own)) {
+			counts.push_back(((uint64_t)rank_ << local_size()) | c.first);
+			counts.push_back(c.second);
+		}
+	}
+
+	map<uint64_t, size_t> all;
+	for (const vector<uint64_t>& c : cluster::all_gather(counts)) {
+		for (size_t j = 0; j + 1 < c.size(); j += 2) all[c[j]] += (size_t)c[j + 1];
+	}
+	return all;
+}
+
+template<typename T>
+void DistributedRegistry<T>::apply(unsigned int target, const complex<double>* m) {
+	if (target < local_size()) local_.apply(target, m);
+	else apply_global(target - local_size(), m, 0, 0);
+}
+
+template<typename T>
+void DistributedRegistry<T>::apply_controlled(unsigned int control, unsigned int target, const complex<double>* m) {
+	unsigned int l = local_size();
+
+	//a global control leaves the ranks where it is 0 alone. the partner of a global target has the same control.
+	if (control >= l) {
+		if (bit(control - l)) apply(target, m);
+		return;
+	}
+	if (target < l) {
+		local_.apply_controlled(control, target, m);
+		return;
+	}
+	size_t mask = (size_t)1 << control;
+	apply_global(target - l, m, mask, mask);
+}
+
+template<typename T>
+void DistributedRegistry<T>::apply_multi_controlled(const vector<unsigned int>& controls, unsigned int target, const complex<double>* m) {
+	unsigned int l = local_size();
+
+	//as for apply_controlled, global controls leave the ranks where any of them is 0 alone
+	vector<unsigned int> local;
+	size_t mask = 0;
+	for (unsigned int c : controls) {
+		if (c < l) {
+			local.push_back(c);
+			mask |= (size_t)1 << c;
+		}
+		else if (!bit(c - l)) return;
+	}
+	if (target < l) local_.apply_multi_controlled(local, target, m);
+	else apply_global(target - l, m, mask, mask);
+}
+
+template<typename T>
+void DistributedRegistry<T>::apply_unitary(const vector<unsigned int>& qubits, const complex<double>* m) {
+	unsigned int l = local_size();
+
+	//global qubits are swapped with the highest local qubits outside qubits, and back
+	vector<unsigned int> mapped(qubits);
+	vector<pair<unsigned int, unsigned int>> pairs;
+	unsigned int slot = l;
+	for (unsigned int& q : mapped) {
+		if (q < l) continue;
+		do slot--; while (find(qubits.begin(), qubits.end(), slot) != qubits.end());
+		pairs.emplace_back(slot, q);
+		q = slot;
+	}
+
+	if (pairs.empty()) {
+		local_.apply_unitary(qubits, m);
+		return;
+	}
+	swap_qubits(pairs);
+	local_.apply_unitary(mapped, m);
+	swap_qubits(pairs);
+}
+
+template<typename T>
+void DistributedRegistry<T>::swap_qubits(const vector<pair<unsigned int, unsigned int>>& pairs) {
+	unsigned int l = local_size();
+	auto import = [this](size_t mask, size_t value) {
+		return [this, mask, value](size_t first, size_t count, const complex<T>* received) {
+			local_.import_amplitudes(mask, value, first, count, received);
+		};
+	};
+
+	vector<pair<unsigned int, unsigned int>> local_pairs;
+	for (const pair<unsigned int, unsigned int>& p : pairs) {
+		unsigned int a = min(p.first, p.second), b = max(p.first, p.second);
+		if (a == b) continue;
+
+		if (b < l) local_pairs.emplace_back(a, b);
+		else if (a >= l) {
+			//ranks where the two global qubits differ exchange their whole parts
+			unsigned int ga = a - l, gb = b - l;
+			if (bit(ga) != bit(gb)) exchange(rank_ ^ (1u << ga) ^ (1u << gb), 0, 0, import(0, 0));
+		}
+		else {
+			//states where local qubit a differs from global qubit b are exchanged with the partner
+			size_t mask = (size_t)1 << a;
+			size_t value = bit(b - l) ? 0 : mask;
+			exchange(rank_ ^ (1u << (b - l)), mask, value, import(mask, value));
+		}
+	}
+	if (!local_pairs.empty()) local_.swap_qubits(local_pairs);
+}
+
+template<typename T>
+void DistributedRegistry<T>::apply_channel(unsigned int target, const vector<complex<double>>& kraus) {
+	if (target >= size_) throw runtime_error("registry not large enough");
+
+	complex<double> rho[4];
+	reduced(target, rho);
+	apply(target, draw_kraus(kraus, rho, draw()).data());
+}
+
+template<typename T>
+void DistributedRegistry<T>::reduced(unsigned int i, complex<double>* rho) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+
+	//a global qubit is swapped with the top local qubit, whose pairs of states are on the same rank
+	unsigned int l = local_size();
+	unsigned int q = (i < l) ? i : l - 1;
+	if (i >= l) swap_qubits({ { q, i } });
+	complex<double> part[4];
+	local_.reduced(q, part);
+	if (i >= l) swap_qubits({ { q, i } });
+
+	//summed in rank order, so that all ranks get the same
+	for (int j = 0; j < 4; j++) {
+		vector<double> re = cluster::all_gather(part[j].real());
+		vector<double> im = cluster::all_gather(part[j].imag());
+		rho[j] = complex<double>(accumulate(re.begin(), re.end(), 0.0), accumulate(im.begin(), im.end(), 0.0));
+	}
+}
+
+template<typename T>
+unsigned int DistributedRegistry<T>::local_qubits() const {
+	return min(local_.local_qubits(), local_size());
+}
+
+template class DistributedRegistry<double>;
+
+template class DistributedRegistry<float>;
@@ -0,0 +1,78 @@
+#pragma once
+#include "quantum.h"
+
+//state vector of 2^size amplitudes split over the ranks of the cluster (a power of 2, 2^k of them) by its top k
+//qubits: rank r holds the states whose top k bits are r, as a registry of the size - k low (local) qubits.
+//gates on local qubits are applied by each rank alone, gates on the top (global) qubits exchange amplitudes
+//between pairs of ranks. all ranks must apply the same operations in the same order.
+template<typename T>
+class DistributedRegistry : public Registry {
+private:
+	BasicQRegistry<T> local_;
+
+	//number of global qubits (k)
+	unsigned int global_;
+
+	unsigned int rank_;
+
+	//true if global qubit g of this rank is 1
+	bool bit(unsigned int g) const { return ((rank_ >> g) & 1) != 0; }
+
+	//uniform double in [0, 1) drawn by rank 0, the same on all ranks
+	static double draw();
+
+	//exchanges the selected states (see BasicQRegistry::export_amplitudes) with partner, which selects as
+	//many states, piece by piece. f(first, count, received) is called after each piece is received.
+	template<typename F>
+	void exchange(unsigned int partner, size_t mask, size_t value, const F& f);
+
+	//applies m to global qubit g, for the local states selected by mask and value
+	void apply_global(unsigned int g, const std::complex<double>* m, size_t mask, size_t value);
+
+public:
+	//constructs registry of given size in state |0...0>, of which this rank holds its part.
+	//the number of ranks must be a power of 2, of at most 2^(size - max_unitary_qubits).
+	//throws memory_exception if the part exceeds memory budget, bad_alloc if allocation fails.
+	DistributedRegistry(unsigned int size, Layout layout = Layout::interleaved);
+
+	//qubits held by each rank
+	unsigned int local_size() const { return local_.size(); }
+
+	void reset() override;
+
+	//amplitude of state i, sent by the rank holding it to all others
+	std::complex<double> amplitude(size_t i) const override;
+
+	bool measure(unsigned int i) override;
+
+	uint64_t measure_all() override;
+
+	std::map<uint64_t, size_t> sample(size_t shots) const override;
+
+	void apply(unsigned int target, const std::complex<double>* m) override;
+
+	void apply_controlled(unsigned int control, unsigned int target, const std::complex<double>* m) override;
+
+	void apply_multi_controlled(const std::vector<unsigned int>& controls, unsigned int target, const std::complex<double>* m) override;
+
+	//global qubits among qubits are first swapped with local qubits
+	void apply_unitary(const std::vector<unsigned int>& qubits, const std::complex<double>* m) override;
+
+	void swap_qubits(const std::vector<std::pair<unsigned int, unsigned int>>& pairs) override;
+
+	//draws the Kraus operator on rank 0, from the reduced density matrix summed over all ranks
+	void apply_channel(unsigned int target, const std::vector<std::complex<double>>& kraus) override;
+
+	//swaps a global qubit i with a local qubit and back
+	void reduced(unsigned int i, std::complex<double>* rho) override;
+
+	unsigned int local_qubits() const override;
+
+	void apply_local(const std::vector<std::unique_ptr<Instruction>>& instructions, unsigned int local) override {
+		local_.apply_local(instructions, local);
+	}
+};
+
+//true if a registry of given size is split over the ranks of the cluster, rather than held whole by each rank:
+//there are several ranks, and each holds at least max_unitary_qubits local qubits
+bool distributable(unsigned int size);
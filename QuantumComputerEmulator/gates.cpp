@@ -1,37 +1,188 @@
 #include "gates.h"
-#include <list>
+#include <stdexcept>
+#include <algorithm>
 
 using namespace std;
 
-void qasm::custom_gate::instruction::apply() {
-	vector<double> params;
-	for (auto i : params_) params.push_back(*i);
+qasm::primitive_gate Rx(qasm::opcode::rx, 1, 1);
 
-	vector<unsigned int> args;
-	for (auto i : args_) args.push_back(*i);
-	
-	gate_->apply(params, args);
+qasm::primitive_gate Ry(qasm::opcode::ry, 1, 1);
+
+qasm::primitive_gate Rz(qasm::opcode::rz, 1, 1);
+
+qasm::primitive_gate Ph(qasm::opcode::ph, 1, 1);
+
+qasm::primitive_gate T(qasm::opcode::t, 0, 1);
+
+qasm::primitive_gate Tdag(qasm::opcode::tdag, 0, 1);
+
+qasm::primitive_gate H(qasm::opcode::h, 0, 1);
+
+qasm::primitive_gate CNot(qasm::opcode::cnot, 0, 2);
+
+qasm::primitive_gate CH(qasm::opcode::ch, 0, 2);
+
+qasm::primitive_gate CCNot(qasm::opcode::mcx, 0, 3);
+
+qasm::primitive_gate MCX(qasm::opcode::mcx, 0, 2, true);
+
+bool is_controlled(qasm::opcode code) {
+	return code == qasm::opcode::cnot || code == qasm::opcode::ch || code == qasm::opcode::mcx;
 }
 
-void qasm::custom_gate::add_instruction(qasm::gate* gate, const vector<pair<double*, unsigned int>>& params,
-	const vector<unsigned int>& args) {
-	
-	vector<shared_ptr<double>> params_vector;
-	for (auto i : params) {
-		if (i.first != nullptr) params_vector.push_back(shared_ptr<double>(new double(*i.first)));
-		else params_vector.push_back(shared_ptr<double>((*params_)[i.second]));
+void op_matrix(qasm::opcode code, double th, complex<double>* m) {
+	switch (code) {
+	case qasm::opcode::rx:
+		m[0] = cos(th / 2);
+		m[1] = -consts::i * sin(th / 2);
+		m[2] = -consts::i * sin(th / 2);
+		m[3] = cos(th / 2);
+		break;
+	case qasm::opcode::ry:
+		m[0] = cos(th / 2);
+		m[1] = -sin(th / 2);
+		m[2] = sin(th / 2);
+		m[3] = cos(th / 2);
+		break;
+	case qasm::opcode::rz:
+		m[0] = cos(th / 2) - consts::i * sin(th / 2);
+		m[1] = 0;
+		m[2] = 0;
+		m[3] = cos(th / 2) + consts::i * sin(th / 2);
+		break;
+	case qasm::opcode::ph:
+		m[0] = 1;
+		m[1] = 0;
+		m[2] = 0;
+		m[3] = cos(th) + consts::i * sin(th);
+		break;
+	case qasm::opcode::t:
+		m[0] = 1;
+		m[1] = 0;
+		m[2] = 0;
+		m[3] = cos(consts::pi / 4) + consts::i * sin(consts::pi / 4);
+		break;
+	case qasm::opcode::tdag:
+		m[0] = 1;
+		m[1] = 0;
+		m[2] = 0;
+		m[3] = cos(consts::pi / 4) - consts::i * sin(consts::pi / 4);
+		break;
+	case qasm::opcode::h:
+	case qasm::opcode::ch:
+		m[0] = m[1] = m[2] = 1 / sqrt(2.0);
+		m[3] = -1 / sqrt(2.0);
+		break;
+	case qasm::opcode::cnot:
+	case qasm::opcode::mcx:
+		m[0] = 0;
+		m[1] = 1;
+		m[2] = 1;
+		m[3] = 0;
+		break;
 	}
+}
 
-	vector<shared_ptr<unsigned int>> args_vector;
-	for (auto i : args) args_vector.push_back(shared_ptr<unsigned int>((*args_)[i]));
+void apply_op(const qasm::op& o, const double* params, const unsigned int* args, const unsigned int* controls, Registry& registry) {
+	double th = (o.param.slot < 0) ? o.param.value : params[o.param.slot]; //angle, in radians
+	unsigned int q = args[o.args[0]]; //target qubit, or control qubit of controlled gates
+	complex<double> m[4]; //2x2 matrix of gate, row-major
+	op_matrix(o.code, th, m);
 
-	li_->push_back(unique_ptr<instruction>(new instruction(gate, params_vector, args_vector)));
+	if (!is_controlled(o.code)) {
+		if (q >= registry.size()) throw runtime_error("registry not large enough");
+		registry.apply(q, m);
+		return;
+	}
+
+	unsigned int target = args[o.args[1]];
+	if (o.code == qasm::opcode::mcx) {
+		//kept from op to op, as the buffers of apply_gate_instruction
+		static vector<unsigned int> qubits;
+		qubits.clear();
+		qubits.push_back(q);
+		for (unsigned int j = 0; j < o.controlc; j++) qubits.push_back(args[controls[o.first_control + j]]);
+		for (size_t i = 0; i < qubits.size(); i++) {
+			if (qubits[i] >= registry.size() || target >= registry.size()) throw runtime_error("registry not large enough");
+			if (qubits[i] == target) throw runtime_error("error: control qubit must be different from target qubit");
+			if (find(qubits.begin(), qubits.begin() + i, qubits[i]) != qubits.begin() + i) throw runtime_error("error: control qubits must be distinct");
+		}
+		registry.apply_multi_controlled(qubits, target, m);
+		return;
+	}
+
+	if (q >= registry.size() || target >= registry.size()) throw runtime_error("registry not large enough");
+	if (q == target) throw runtime_error("error: control qubit must be different from target qubit");
+	registry.apply_controlled(q, target, m);
+}
+
+Instruction* op_instruction(const qasm::op& o, const unsigned int* controls) {
+	complex<double> m[4];
+	op_matrix(o.code, o.param.value, m);
+
+	if (is_controlled(o.code)) {
+		if (o.args[0] == o.args[1]) throw runtime_error("error: control qubit must be different from target qubit");
+		if (o.code != qasm::opcode::mcx) return new CGateInstruction(m, o.args[0], o.args[1]);
+
+		vector<unsigned int> qubits = { o.args[0] };
+		for (unsigned int j = 0; j < o.controlc; j++) {
+			unsigned int c = controls[o.first_control + j];
+			if (c == o.args[1]) throw runtime_error("error: control qubit must be different from target qubit");
+			if (find(qubits.begin(), qubits.end(), c) != qubits.end()) throw runtime_error("error: control qubits must be distinct");
+			qubits.push_back(c);
+		}
+		return new MultiControlledInstruction(qubits, o.args[1], m);
+	}
+	return new GateInstruction(m, o.args[0]);
+}
+
+qasm::op qasm::primitive_gate::op(unsigned int argc) const {
+	unsigned int controlc = (code_ == qasm::opcode::mcx && argc > 2) ? argc - 2 : 0;
+	qasm::op o = { code_, { 0, argc - 1 }, { paramc_ > 0 ? 0 : -1, 0 }, 1, controlc };
+	return o;
+}
+
+//slots 0, 1, 2, ...: the array of controls of the op of a primitive gate applied to its own arguments
+static vector<unsigned int> slots;
+
+void qasm::primitive_gate::apply(const vector<double>& params, const vector<unsigned int>& args) const {
+	//slots of the op are the given parameters and arguments themselves
+	while (slots.size() < args.size()) slots.push_back((unsigned int)slots.size());
+	apply_op(op((unsigned int)args.size()), params.data(), args.data(), slots.data(), *registry);
+}
+
+void qasm::primitive_gate::compile(const vector<qasm::param_ref>& params, const vector<unsigned int>& args,
+	vector<qasm::op>& ops, vector<unsigned int>& controls) const {
+
+	qasm::op o = op((unsigned int)args.size());
+	o.args[0] = args[o.args[0]];
+	o.args[1] = args[o.args[1]];
+	for (unsigned int j = 0; j < o.controlc; j++) controls.push_back(args[o.first_control + j]);
+	o.first_control = (unsigned int)(controls.size() - o.controlc);
+	if (paramc_ > 0) o.param = params[0];
+	ops.push_back(o);
+}
+
+void qasm::custom_gate::add_instruction(qasm::gate* gate, const vector<qasm::param_ref>& params,
+	const vector<unsigned int>& args) {
+	
+	gate->compile(params, args, ops_, controls_);
 }
 
 void qasm::custom_gate::apply(const vector<double>& params, const vector<unsigned int>& args) const {
-	for (int i = 0; i < paramc(); i++) *((*params_)[i]) = params[i];
+	for (const qasm::op& o : ops_) apply_op(o, params.data(), args.data(), controls_.data(), *registry);
+}
 
-	for (int i = 0; i < argc(); i++) *((*args_)[i]) = args[i];
+void qasm::custom_gate::compile(const vector<qasm::param_ref>& params, const vector<unsigned int>& args,
+	vector<qasm::op>& ops, vector<unsigned int>& controls) const {
 
-	for (list<unique_ptr<instruction>>::iterator it = li_->begin(); it != li_->end(); it++) (*it)->apply();
+	//resolve slots of this gate to slots of the enclosing one
+	for (qasm::op o : ops_) {
+		o.args[0] = args[o.args[0]];
+		o.args[1] = args[o.args[1]];
+		for (unsigned int j = 0; j < o.controlc; j++) controls.push_back(args[controls_[o.first_control + j]]);
+		o.first_control = (unsigned int)(controls.size() - o.controlc);
+		if (o.param.slot >= 0) o.param = params[o.param.slot];
+		ops.push_back(o);
+	}
 }
\ No newline at end of file
@@ -4,13 +4,11 @@
 #include <vector>
 #include <cmath>
 #include <complex>
-#include <list>
-#include <memory>
 #include <utility>
 
 //using namespace std::complex_literals;
 
-extern QRegistry* registry;
+extern Registry* registry;
 
 namespace consts {
 	extern std::complex<double> i;
@@ -18,231 +16,104 @@ namespace consts {
 	extern double pi;
 }
 
-class : public qasm::gate {
-public:
-	unsigned int paramc() const override { return 1; }
-
-	unsigned int argc() const override { return 1; }
-
-	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override {
-		double th = params[0]; //angle of rotation, in radians
-		const Qubit q1(cos(th / 2), -(consts::i) * sin(th / 2));
-		const Qubit q2(-consts::i * sin(th / 2), cos(th / 2));
-		const Gate gate(q1, q2);
+//true for ops on a control and a target qubit (args[0] and args[1]), false for ops on one qubit (args[0]).
+//mcx ops are conditioned by their further controls as well.
+bool is_controlled(qasm::opcode code);
 
-		unsigned int q = args[0]; //target qubit
-
-		GateInstruction i(gate, q);
-		i(*registry);
-	}
-} Rx;
-
-class : public qasm::gate {
-public:
-	unsigned int paramc() const override { return 1; }
+//writes 2x2 matrix (row-major) of primitive op with angle th (ignored if op takes no parameter).
+//for controlled ops it is the matrix applied to the target qubit.
+void op_matrix(qasm::opcode code, double th, std::complex<double>* m);
 
-	unsigned int argc() const override { return 1; }
-
-	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override {
-		double th = params[0]; //angle of rotation, in radians
-		const Qubit q1(cos(th / 2), sin(th / 2));
-		const Qubit q2(-sin(th / 2), cos(th / 2));
-		const Gate gate(q1, q2);
-
-		unsigned int q = args[0]; //target qubit
-
-		GateInstruction i(gate, q);
-		i(*registry);
-	}
-} Ry;
-
-class : public qasm::gate {
-public:
-	unsigned int paramc() const override { return 1; }
+//applies primitive op o to registry, taking its arguments and parameters from slots args and params, and the slots
+//of its further controls from controls
+void apply_op(const qasm::op& o, const double* params, const unsigned int* args, const unsigned int* controls, Registry& registry);
 
-	unsigned int argc() const override { return 1; }
+//returns new instruction applying primitive op o, whose arguments and further controls (in controls) are qubits and
+//parameter is constant
+Instruction* op_instruction(const qasm::op& o, const unsigned int* controls);
 
-	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override {
-		double th = params[0]; //angle of rotation, in radians
-		const Qubit q1(cos(th / 2) - consts::i * sin(th / 2), 0);
-		const Qubit q2(0, cos(th / 2) + consts::i * sin(th / 2));
-		const Gate gate(q1, q2);
-
-		unsigned int q = args[0]; //target qubit
-
-		GateInstruction i(gate, q);
-		i(*registry);
-	}
-} Rz;
-
-class : public qasm::gate {
-public:
-	unsigned int paramc() const override { return 1; }
-
-	unsigned int argc() const override { return 1; }
-
-	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override {
-		double th = params[0];
-		
-		const Qubit q1(1, 0);
-		const Qubit q2(0, cos(th) + consts::i * sin(th));
-		const Gate gate(q1, q2);
-
-		unsigned int q = args[0]; //target qubit
-
-		GateInstruction i(gate, q);
-		i(*registry);
-	}
-} Ph; //multiplies qubit by phase e^(i*theta) for state |1>, does nothing for phase |0>
-
-class : public qasm::gate {
-public:
-	unsigned int paramc() const override { return 0; }
-
-	unsigned int argc() const override { return 1; }
-
-	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override {
-		const Qubit q1(1, 0);
-		const Qubit q2(0, cos(consts::pi / 4) + consts::i * sin(consts::pi / 4));
-		const Gate gate(q1, q2);
-
-		unsigned int q = args[0]; //target qubit
+//a built-in gate, consisting of a single primitive op
+class qasm::primitive_gate : public qasm::gate {
+private:
+	qasm::opcode code_;
+	unsigned int paramc_;
+	unsigned int argc_;
+	bool variadic_;
 
-		GateInstruction i(gate, q);
-		i(*registry);
-	}
-} T;
+	//op of the gate applied to arguments in slots 0 to argc - 1, the last being the target. its further controls
+	//are entries 1 to argc - 2 of an array of controls.
+	qasm::op op(unsigned int argc) const;
 
-class : public qasm::gate {
 public:
-	unsigned int paramc() const override { return 0; }
-
-	unsigned int argc() const override { return 1; }
+	//gate of a variadic controlled op takes argc or more arguments, all but the last being controls
+	primitive_gate(qasm::opcode code, unsigned int paramc, unsigned int argc, bool variadic = false)
+		: code_(code), paramc_(paramc), argc_(argc), variadic_(variadic) {}
 
-	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override {
-		const Qubit q1(1, 0);
-		const Qubit q2(0, cos(consts::pi / 4) - consts::i * sin(consts::pi / 4));
-		const Gate gate(q1, q2);
+	unsigned int paramc() const override { return paramc_; }
 
-		unsigned int q = args[0]; //target qubit
+	unsigned int argc() const override { return argc_; }
 
-		GateInstruction i(gate, q);
-		i(*registry);
-	}
-} Tdag;
+	bool variadic() const override { return variadic_; }
 
-class : public qasm::gate {
-public:
-	unsigned int paramc() const override { return 0; }
-
-	unsigned int argc() const override { return 1; }
-
-	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override {
-		const Qubit q1(1, 1);
-		const Qubit q2(1, -1);
-		const Gate gate(q1, q2);
+	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override;
 
-		unsigned int q = args[0]; //target qubit
+	void compile(const std::vector<qasm::param_ref>& params, const std::vector<unsigned int>& args,
+		std::vector<qasm::op>& ops, std::vector<unsigned int>& controls) const override;
+};
 
-		GateInstruction i(gate, q);
-		i(*registry);
-	}
-} H;
+extern qasm::primitive_gate Rx; //rotation around x axis by angle given in radians
 
-class : public qasm::gate {
-public:
-	unsigned int paramc() const override { return 0; }
+extern qasm::primitive_gate Ry; //rotation around y axis by angle given in radians
 
-	unsigned int argc() const override { return 2; }
+extern qasm::primitive_gate Rz; //rotation around z axis by angle given in radians
 
-	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override {
-		const Qubit q1(0, 1);
-		const Qubit q2(1, 0);
-		const Gate nt(q1, q2); //not gate
-		const CGate cnot(nt);
+extern qasm::primitive_gate Ph; //multiplies qubit by phase e^(i*theta) for state |1>, does nothing for phase |0>
 
-		unsigned int control = args[0]; //control qubit
-		unsigned int target = args[1]; //target qubit
+extern qasm::primitive_gate T;
 
-		CGateInstruction i(cnot, control, target);
-		i(*registry);
-	}
-} CNot;
+extern qasm::primitive_gate Tdag;
 
-class : public qasm::gate {
-public:
-	unsigned int paramc() const override { return 0; }
+extern qasm::primitive_gate H;
 
-	unsigned int argc() const override { return 2; }
+extern qasm::primitive_gate CNot;
 
-	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override {
-		const Qubit q1(1, 1);
-		const Qubit q2(1, -1);
-		const Gate nt(q1, q2); //not gate
-		const CGate cnot(nt);
+extern qasm::primitive_gate CH;
 
-		unsigned int control = args[0]; //control qubit
-		unsigned int target = args[1]; //target qubit
+extern qasm::primitive_gate CCNot; //Toffoli gate: not of the third qubit if the first two are 1
 
-		CGateInstruction i(cnot, control, target);
-		i(*registry);
-	}
-} CH;
+extern qasm::primitive_gate MCX; //not of the last qubit if all others are 1
 
+//a user defined gate. its body is compiled at definition time into a flat sequence of primitive ops
+//(nested user defined gates included), so applying it is a single loop without allocation.
 class qasm::custom_gate : public qasm::gate {
-public:
-	class instruction;
-
 private:
-	std::list<std::unique_ptr<qasm::custom_gate::instruction>>* li_;
+	unsigned int paramc_;
 
-	std::vector<std::shared_ptr<double>>* params_;
+	unsigned int argc_;
 
-	std::vector<std::shared_ptr<unsigned int>>* args_;
+	std::vector<qasm::op> ops_;
+
+	//slots of the further controls of the mcx ops of ops_
+	std::vector<unsigned int> controls_;
 
 public:
 	//construct new empty custom_gate with paramc parameters and argc arguments
-	custom_gate(unsigned int paramc, unsigned int argc) {
-		li_ = new std::list<std::unique_ptr<instruction>>;
-
-		params_ = new std::vector<std::shared_ptr<double>>;
-		for (unsigned int i = 0; i < paramc; i++) params_->push_back(std::shared_ptr<double>(new double(0)));
+	custom_gate(unsigned int paramc, unsigned int argc) : paramc_(paramc), argc_(argc) {}
 
-		args_ = new std::vector<std::shared_ptr<unsigned int>>;
-		for (unsigned int i = 0; i < argc; i++) args_->push_back(std::shared_ptr<unsigned int>(new unsigned int(0)));
-	}
+	//add an instruction to end of custom_gate, defined by a gate, a vector of parameters (constants, or slots of
+	//parameters of custom_gate), and a vector of indexes of arguments in custom_gate.
+	void add_instruction(qasm::gate*, const std::vector<qasm::param_ref>&, const std::vector<unsigned int>&);
 	
-	~custom_gate() override {
-		delete li_;
+	unsigned int paramc() const override { return paramc_; }
 
-		delete params_;
+	unsigned int argc() const override { return argc_; }
 
-		delete args_;
-	}
+	const std::vector<qasm::op>& ops() const { return ops_; }
 
-	//add an instruction to end of custom_gate, defined by a gate, a vector of parameters (or if nullptr then
-	//index of parameter in custom_gate), and a vector of indexes of arguments in custom_gate.
-	void add_instruction(qasm::gate*, const std::vector<std::pair<double*, unsigned int>>&,
-		const std::vector<unsigned int>&);
-	
-	unsigned int paramc() const override { return params_->size(); }
-
-	unsigned int argc() const override { return args_->size(); }
+	const std::vector<unsigned int>& controls() const { return controls_; }
 
 	void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const override;
 
-	class instruction {
-	private:
-		const qasm::gate* gate_;
-		const std::vector<std::shared_ptr<double>> params_;
-		const std::vector<std::shared_ptr<unsigned int>> args_;
-
-	public:
-		instruction(const qasm::gate* gate, const std::vector<std::shared_ptr<double>>& params,
-			const std::vector<std::shared_ptr<unsigned int>>& args) : gate_(gate), params_(params), args_(args) {}
-
-		~instruction() { delete gate_; }
-
-		void apply();
-	};
+	void compile(const std::vector<qasm::param_ref>& params, const std::vector<unsigned int>& args,
+		std::vector<qasm::op>& ops, std::vector<unsigned int>& controls) const override;
 };
\ No newline at end of file
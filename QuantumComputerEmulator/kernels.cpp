@@ -0,0 +1,158 @@
+#include "kernels.h"
+#include "kernels_scalar.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+template<typename T>
+static void high_scalar(complex<T>* p0, complex<T>* p1, size_t n, const complex<T>* m) {
+	for (size_t j = 0; j < n; j++) {
+		complex<T> a0 = p0[j];
+		complex<T> a1 = p1[j];
+		p0[j] = m[0] * a0 + m[1] * a1;
+		p1[j] = m[2] * a0 + m[3] * a1;
+	}
+}
+
+template<typename T>
+static void low_scalar(complex<T>* p, size_t n, const complex<T>* m) {
+	for (size_t j = 0; j < n; j++) {
+		complex<T> a0 = p[2 * j];
+		complex<T> a1 = p[2 * j + 1];
+		p[2 * j] = m[0] * a0 + m[1] * a1;
+		p[2 * j + 1] = m[2] * a0 + m[3] * a1;
+	}
+}
+
+template<typename T>
+static void scale_scalar(complex<T>* p, size_t n, const complex<T>* c) {
+	for (size_t j = 0; j < n; j++) p[j] *= *c;
+}
+
+template<typename T>
+static void diagonal_low_scalar(complex<T>* p, size_t n, const complex<T>* d) {
+	for (size_t j = 0; j < n; j++) {
+		p[2 * j] *= d[0];
+		p[2 * j + 1] *= d[1];
+	}
+}
+
+const kernels::kernel_set<double> kernels::scalar = {
+	"scalar", high_scalar<double>, low_scalar<double>, scale_scalar<double>, diagonal_low_scalar<double>
+};
+
+const kernels::kernel_set<float> kernels::scalar_float = {
+	"scalar", high_scalar<float>, low_scalar<float>, scale_scalar<float>, diagonal_low_scalar<float>
+};
+
+template<typename T>
+static void high_split_scalar(T* re0, T* im0, T* re1, T* im1, size_t n, const complex<T>* m) {
+	split_update(re0, im0, re1, im1, n, 1, reinterpret_cast<const T*>(m));
+}
+
+template<typename T>
+static void low_split_scalar(T* re, T* im, size_t n, const complex<T>* m) {
+	split_update(re, im, re + 1, im + 1, n, 2, reinterpret_cast<const T*>(m));
+}
+
+template<typename T>
+static void scale_split_scalar(T* re, T* im, size_t n, const complex<T>* c) {
+	split_multiply(re, im, n, 1, reinterpret_cast<const T*>(c));
+}
+
+template<typename T>
+static void diagonal_low_split_scalar(T* re, T* im, size_t n, const complex<T>* d) {
+	split_multiply(re, im, n, 2, reinterpret_cast<const T*>(d));
+	split_multiply(re + 1, im + 1, n, 2, reinterpret_cast<const T*>(d + 1));
+}
+
+const kernels::split_kernel_set<double> kernels::scalar_split = {
+	"scalar", high_split_scalar<double>, low_split_scalar<double>, scale_split_scalar<double>, diagonal_low_split_scalar<double>
+};
+
+const kernels::split_kernel_set<float> kernels::scalar_split_float = {
+	"scalar", high_split_scalar<float>, low_split_scalar<float>, scale_split_scalar<float>, diagonal_low_split_scalar<float>
+};
+
+#ifdef _MSC_VER
+//checks cpuid feature bits, and that the os saves the vector registers (xcr0) on context switch
+static bool cpu_has(bool avx512) {
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	if (!osxsave || !fma) return false;
+
+	unsigned long long xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6) return false;
+
+	__cpuidex(info, 7, 0);
+	if (!avx512) return (info[1] & (1 << 5)) != 0;
+	return (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe0) == 0xe0;
+}
+#else
+static bool cpu_has(bool avx512) {
+	__builtin_cpu_init();
+	if (!avx512) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+//instruction sets, from narrowest to widest
+static const char* const names[] = { "scalar", "avx2", "avx512" };
+
+bool kernels::supported(const string& name) {
+	if (name.compare("avx512") == 0) return cpu_has(true);
+	if (name.compare("avx2") == 0) return cpu_has(false);
+	return name.compare("scalar") == 0;
+}
+
+//index of selected instruction set in names, or -1 before the first use
+static int selected = -1;
+
+static int selected_set() {
+	if (selected < 0) {
+		selected = 0;
+		for (int i = 0; i < 3; i++) if (kernels::supported(names[i])) selected = i;
+	}
+	return selected;
+}
+
+template<>
+const kernels::kernel_set<double>& kernels::active<double>() {
+	static const kernel_set<double>* const sets[] = { &scalar, &avx2, &avx512 };
+	return *sets[selected_set()];
+}
+
+template<>
+const kernels::kernel_set<float>& kernels::active<float>() {
+	static const kernel_set<float>* const sets[] = { &scalar_float, &avx2_float, &avx512_float };
+	return *sets[selected_set()];
+}
+
+template<>
+const kernels::split_kernel_set<double>& kernels::active_split<double>() {
+	static const split_kernel_set<double>* const sets[] = { &scalar_split, &avx2_split, &avx512_split };
+	return *sets[selected_set()];
+}
+
+template<>
+const kernels::split_kernel_set<float>& kernels::active_split<float>() {
+	static const split_kernel_set<float>* const sets[] = { &scalar_split_float, &avx2_split_float, &avx512_split_float };
+	return *sets[selected_set()];
+}
+
+bool kernels::select(const string& name) {
+	for (int i = 0; i < 3; i++) {
+		if (name.compare(names[i]) != 0) continue;
+		if (!supported(name)) return false;
+		selected = i;
+		return true;
+	}
+	return false;
+}
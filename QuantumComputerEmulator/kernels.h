@@ -0,0 +1,110 @@
+#pragma once
+#include <complex>
+#include <cstddef>
+#include <string>
+
+//inner loops updating pairs of amplitudes by a 2x2 matrix m (row-major), with one implementation per
+//instruction set and precision T of the amplitudes (float or double). the vectorized sets are compiled in their
+//own files with the matching compiler flags, and are only called if the cpu supports them.
+namespace kernels {
+	//updates pairs (p0[j], p1[j]) for j in [0, n), for a target qubit above 0 (both halves contiguous)
+	template<typename T>
+	using high_kernel = void (*)(std::complex<T>* p0, std::complex<T>* p1, size_t n, const std::complex<T>* m);
+
+	//updates pairs (p[2j], p[2j + 1]) for j in [0, n), for target qubit 0 (pairs interleaved)
+	template<typename T>
+	using low_kernel = void (*)(std::complex<T>* p, size_t n, const std::complex<T>* m);
+
+	//multiplies p[j] for j in [0, n) by *c (a diagonal gate on a contiguous half)
+	template<typename T>
+	using scale_kernel = void (*)(std::complex<T>* p, size_t n, const std::complex<T>* c);
+
+	//multiplies p[2j] by d[0] and p[2j + 1] by d[1] for j in [0, n) (a diagonal gate on target qubit 0)
+	template<typename T>
+	using diagonal_low_kernel = void (*)(std::complex<T>* p, size_t n, const std::complex<T>* d);
+
+	template<typename T>
+	struct kernel_set {
+		const char* name;
+		high_kernel<T> high;
+		low_kernel<T> low;
+		scale_kernel<T> scale;
+		diagonal_low_kernel<T> diagonal_low;
+	};
+
+	extern const kernel_set<double> scalar;
+
+	extern const kernel_set<double> avx2;
+
+	extern const kernel_set<double> avx512;
+
+	extern const kernel_set<float> scalar_float;
+
+	extern const kernel_set<float> avx2_float;
+
+	extern const kernel_set<float> avx512_float;
+
+	//the same updates for amplitudes stored as an array of real parts re and an array of imaginary parts im,
+	//where vector registers hold parts of consecutive amplitudes without shuffling
+
+	template<typename T>
+	using split_high_kernel = void (*)(T* re0, T* im0, T* re1, T* im1, size_t n, const std::complex<T>* m);
+
+	template<typename T>
+	using split_low_kernel = void (*)(T* re, T* im, size_t n, const std::complex<T>* m);
+
+	template<typename T>
+	using split_scale_kernel = void (*)(T* re, T* im, size_t n, const std::complex<T>* c);
+
+	template<typename T>
+	using split_diagonal_low_kernel = void (*)(T* re, T* im, size_t n, const std::complex<T>* d);
+
+	template<typename T>
+	struct split_kernel_set {
+		const char* name;
+		split_high_kernel<T> high;
+		split_low_kernel<T> low;
+		split_scale_kernel<T> scale;
+		split_diagonal_low_kernel<T> diagonal_low;
+	};
+
+	extern const split_kernel_set<double> scalar_split;
+
+	extern const split_kernel_set<double> avx2_split;
+
+	extern const split_kernel_set<double> avx512_split;
+
+	extern const split_kernel_set<float> scalar_split_float;
+
+	extern const split_kernel_set<float> avx2_split_float;
+
+	extern const split_kernel_set<float> avx512_split_float;
+
+	//kernels used by registries of std::complex<T> amplitudes: the widest set supported by the cpu,
+	//unless another was selected
+	template<typename T>
+	const kernel_set<T>& active();
+
+	template<>
+	const kernel_set<double>& active<double>();
+
+	template<>
+	const kernel_set<float>& active<float>();
+
+	//kernels of the same instruction set as active, for split real and imaginary parts
+	template<typename T>
+	const split_kernel_set<T>& active_split();
+
+	template<>
+	const split_kernel_set<double>& active_split<double>();
+
+	template<>
+	const split_kernel_set<float>& active_split<float>();
+
+	//selects kernel sets (of both precisions) by name (scalar, avx2 or avx512). returns false if the cpu does not
+	//support them.
+	bool select(const std::string& name);
+
+	//true if the cpu supports kernel set of given name
+	bool supported(const std::string& name);
+}
@@ -0,0 +1,362 @@
+#include "kernels.h"
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#pragma GCC target("avx2,fma")
+#endif
+#include <immintrin.h>
+#include "kernels_scalar.h"
+
+using namespace std;
+
+//this file is compiled for avx2, so it must not instantiate any inline function shared with other files (the loops
+//of kernels_scalar.h are static, and compiled here for avx2 too).
+//amplitudes are handled as pairs of doubles (or floats) (real, imaginary), and m[2k], m[2k + 1] are the parts of entry k.
+
+//contiguous halves: each register holds 2 amplitudes of one half, multiplied by broadcast matrix entries.
+//for b = x * a + y * c: real parts are (xr ar + yr cr) - (xi ai + yi ci), imaginary parts (xr ai + yr ci) + (xi ar + yi cr),
+//so the terms with imaginary matrix parts use the swapped (imaginary, real) amplitudes and fmaddsub combines them.
+static void high_avx2(complex<double>* p0c, complex<double>* p1c, size_t n, const complex<double>* mc) {
+	double* p0 = reinterpret_cast<double*>(p0c);
+	double* p1 = reinterpret_cast<double*>(p1c);
+	const double* m = reinterpret_cast<const double*>(mc);
+
+	__m256d m0r = _mm256_set1_pd(m[0]), m0i = _mm256_set1_pd(m[1]);
+	__m256d m1r = _mm256_set1_pd(m[2]), m1i = _mm256_set1_pd(m[3]);
+	__m256d m2r = _mm256_set1_pd(m[4]), m2i = _mm256_set1_pd(m[5]);
+	__m256d m3r = _mm256_set1_pd(m[6]), m3i = _mm256_set1_pd(m[7]);
+
+	size_t j = 0;
+	for (; j + 2 <= n; j += 2) {
+		__m256d a0 = _mm256_loadu_pd(p0 + 2 * j);
+		__m256d a1 = _mm256_loadu_pd(p1 + 2 * j);
+		__m256d s0 = _mm256_permute_pd(a0, 0x5);
+		__m256d s1 = _mm256_permute_pd(a1, 0x5);
+
+		__m256d b0 = _mm256_fmadd_pd(m1r, a1, _mm256_fmaddsub_pd(m0r, a0, _mm256_fmadd_pd(m1i, s1, _mm256_mul_pd(m0i, s0))));
+		__m256d b1 = _mm256_fmadd_pd(m3r, a1, _mm256_fmaddsub_pd(m2r, a0, _mm256_fmadd_pd(m3i, s1, _mm256_mul_pd(m2i, s0))));
+
+		_mm256_storeu_pd(p0 + 2 * j, b0);
+		_mm256_storeu_pd(p1 + 2 * j, b1);
+	}
+
+	for (; j < n; j++) pair_tail(p0 + 2 * j, p1 + 2 * j, m);
+}
+
+//interleaved pairs: a register holds one pair (a0, a1), shuffled into (a0, a0) and (a1, a1) so that
+//the lower half computes b0 and the upper half b1 with per-half matrix entries.
+static void low_avx2(complex<double>* pc, size_t n, const complex<double>* mc) {
+	double* p = reinterpret_cast<double*>(pc);
+	const double* m = reinterpret_cast<const double*>(mc);
+
+	__m256d xr = _mm256_setr_pd(m[0], m[0], m[4], m[4]), xi = _mm256_setr_pd(m[1], m[1], m[5], m[5]);
+	__m256d yr = _mm256_setr_pd(m[2], m[2], m[6], m[6]), yi = _mm256_setr_pd(m[3], m[3], m[7], m[7]);
+
+	for (size_t j = 0; j < n; j++) {
+		__m256d v = _mm256_loadu_pd(p + 4 * j);
+		__m256d a0 = _mm256_permute2f128_pd(v, v, 0x00);
+		__m256d a1 = _mm256_permute2f128_pd(v, v, 0x11);
+		__m256d s0 = _mm256_permute_pd(a0, 0x5);
+		__m256d s1 = _mm256_permute_pd(a1, 0x5);
+
+		__m256d b = _mm256_fmadd_pd(yr, a1, _mm256_fmaddsub_pd(xr, a0, _mm256_fmadd_pd(yi, s1, _mm256_mul_pd(xi, s0))));
+
+		_mm256_storeu_pd(p + 4 * j, b);
+	}
+}
+
+//multiplies by a complex constant: real parts cr ar - ci ai, imaginary parts cr ai + ci ar
+static void scale_avx2(complex<double>* pc, size_t n, const complex<double>* cc) {
+	double* p = reinterpret_cast<double*>(pc);
+	const double* c = reinterpret_cast<const double*>(cc);
+
+	__m256d cr = _mm256_set1_pd(c[0]), ci = _mm256_set1_pd(c[1]);
+
+	size_t j = 0;
+	for (; j + 2 <= n; j += 2) {
+		__m256d a = _mm256_loadu_pd(p + 2 * j);
+		_mm256_storeu_pd(p + 2 * j, _mm256_fmaddsub_pd(cr, a, _mm256_mul_pd(ci, _mm256_permute_pd(a, 0x5))));
+	}
+
+	for (; j < n; j++) {
+		double ar = p[2 * j], ai = p[2 * j + 1];
+		p[2 * j] = c[0] * ar - c[1] * ai;
+		p[2 * j + 1] = c[0] * ai + c[1] * ar;
+	}
+}
+
+//same as scale, with the constant alternating between d[0] and d[1] along the amplitudes
+static void diagonal_low_avx2(complex<double>* pc, size_t n, const complex<double>* dc) {
+	double* p = reinterpret_cast<double*>(pc);
+	const double* d = reinterpret_cast<const double*>(dc);
+
+	__m256d dr = _mm256_setr_pd(d[0], d[0], d[2], d[2]);
+	__m256d di = _mm256_setr_pd(d[1], d[1], d[3], d[3]);
+
+	//each pair of amplitudes fills one register, so there is no tail
+	for (size_t j = 0; j < n; j++) {
+		__m256d a = _mm256_loadu_pd(p + 4 * j);
+		_mm256_storeu_pd(p + 4 * j, _mm256_fmaddsub_pd(dr, a, _mm256_mul_pd(di, _mm256_permute_pd(a, 0x5))));
+	}
+}
+
+const kernels::kernel_set<double> kernels::avx2 = { "avx2", high_avx2, low_avx2, scale_avx2, diagonal_low_avx2 };
+
+//single precision: a register holds 4 amplitudes, and swapping real and imaginary parts stays within 64-bit pairs
+
+static void high_avx2_float(complex<float>* p0c, complex<float>* p1c, size_t n, const complex<float>* mc) {
+	float* p0 = reinterpret_cast<float*>(p0c);
+	float* p1 = reinterpret_cast<float*>(p1c);
+	const float* m = reinterpret_cast<const float*>(mc);
+
+	__m256 m0r = _mm256_set1_ps(m[0]), m0i = _mm256_set1_ps(m[1]);
+	__m256 m1r = _mm256_set1_ps(m[2]), m1i = _mm256_set1_ps(m[3]);
+	__m256 m2r = _mm256_set1_ps(m[4]), m2i = _mm256_set1_ps(m[5]);
+	__m256 m3r = _mm256_set1_ps(m[6]), m3i = _mm256_set1_ps(m[7]);
+
+	size_t j = 0;
+	for (; j + 4 <= n; j += 4) {
+		__m256 a0 = _mm256_loadu_ps(p0 + 2 * j);
+		__m256 a1 = _mm256_loadu_ps(p1 + 2 * j);
+		__m256 s0 = _mm256_permute_ps(a0, 0xb1);
+		__m256 s1 = _mm256_permute_ps(a1, 0xb1);
+
+		__m256 b0 = _mm256_fmadd_ps(m1r, a1, _mm256_fmaddsub_ps(m0r, a0, _mm256_fmadd_ps(m1i, s1, _mm256_mul_ps(m0i, s0))));
+		__m256 b1 = _mm256_fmadd_ps(m3r, a1, _mm256_fmaddsub_ps(m2r, a0, _mm256_fmadd_ps(m3i, s1, _mm256_mul_ps(m2i, s0))));
+
+		_mm256_storeu_ps(p0 + 2 * j, b0);
+		_mm256_storeu_ps(p1 + 2 * j, b1);
+	}
+
+	for (; j < n; j++) pair_tail(p0 + 2 * j, p1 + 2 * j, m);
+}
+
+//interleaved pairs: each 128-bit lane holds one pair (a0, a1), duplicated into (a0, a0) and (a1, a1) within the lane
+static void low_avx2_float(complex<float>* pc, size_t n, const complex<float>* mc) {
+	float* p = reinterpret_cast<float*>(pc);
+	const float* m = reinterpret_cast<const float*>(mc);
+
+	__m256 xr = _mm256_setr_ps(m[0], m[0], m[4], m[4], m[0], m[0], m[4], m[4]);
+	__m256 xi = _mm256_setr_ps(m[1], m[1], m[5], m[5], m[1], m[1], m[5], m[5]);
+	__m256 yr = _mm256_setr_ps(m[2], m[2], m[6], m[6], m[2], m[2], m[6], m[6]);
+	__m256 yi = _mm256_setr_ps(m[3], m[3], m[7], m[7], m[3], m[3], m[7], m[7]);
+
+	size_t j = 0;
+	for (; j + 2 <= n; j += 2) {
+		__m256 v = _mm256_loadu_ps(p + 4 * j);
+		__m256 a0 = _mm256_permute_ps(v, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 a1 = _mm256_permute_ps(v, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s0 = _mm256_permute_ps(a0, 0xb1);
+		__m256 s1 = _mm256_permute_ps(a1, 0xb1);
+
+		__m256 b = _mm256_fmadd_ps(yr, a1, _mm256_fmaddsub_ps(xr, a0, _mm256_fmadd_ps(yi, s1, _mm256_mul_ps(xi, s0))));
+
+		_mm256_storeu_ps(p + 4 * j, b);
+	}
+
+	for (; j < n; j++) pair_tail(p + 4 * j, p + 4 * j + 2, m);
+}
+
+static void scale_avx2_float(complex<float>* pc, size_t n, const complex<float>* cc) {
+	float* p = reinterpret_cast<float*>(pc);
+	const float* c = reinterpret_cast<const float*>(cc);
+
+	__m256 cr = _mm256_set1_ps(c[0]), ci = _mm256_set1_ps(c[1]);
+
+	size_t j = 0;
+	for (; j + 4 <= n; j += 4) {
+		__m256 a = _mm256_loadu_ps(p + 2 * j);
+		_mm256_storeu_ps(p + 2 * j, _mm256_fmaddsub_ps(cr, a, _mm256_mul_ps(ci, _mm256_permute_ps(a, 0xb1))));
+	}
+
+	for (; j < n; j++) {
+		float ar = p[2 * j], ai = p[2 * j + 1];
+		p[2 * j] = c[0] * ar - c[1] * ai;
+		p[2 * j + 1] = c[0] * ai + c[1] * ar;
+	}
+}
+
+static void diagonal_low_avx2_float(complex<float>* pc, size_t n, const complex<float>* dc) {
+	float* p = reinterpret_cast<float*>(pc);
+	const float* d = reinterpret_cast<const float*>(dc);
+
+	__m256 dr = _mm256_setr_ps(d[0], d[0], d[2], d[2], d[0], d[0], d[2], d[2]);
+	__m256 di = _mm256_setr_ps(d[1], d[1], d[3], d[3], d[1], d[1], d[3], d[3]);
+
+	size_t j = 0;
+	for (; j + 2 <= n; j += 2) {
+		__m256 a = _mm256_loadu_ps(p + 4 * j);
+		_mm256_storeu_ps(p + 4 * j, _mm256_fmaddsub_ps(dr, a, _mm256_mul_ps(di, _mm256_permute_ps(a, 0xb1))));
+	}
+
+	for (; j < n; j++) {
+		for (int h = 0; h < 2; h++) {
+			float ar = p[4 * j + 2 * h], ai = p[4 * j + 2 * h + 1];
+			p[4 * j + 2 * h] = d[2 * h] * ar - d[2 * h + 1] * ai;
+			p[4 * j + 2 * h + 1] = d[2 * h] * ai + d[2 * h + 1] * ar;
+		}
+	}
+}
+
+const kernels::kernel_set<float> kernels::avx2_float = {
+	"avx2", high_avx2_float, low_avx2_float, scale_avx2_float, diagonal_low_avx2_float
+};
+
+//split layout: registers hold real or imaginary parts of consecutive amplitudes, so the complex arithmetic
+//is plain multiply-adds without shuffles. for target qubit 0 a register holds whole pairs, and swapping its
+//neighbouring lanes puts the other amplitude of each pair beside it.
+
+static void high_split_avx2(double* re0, double* im0, double* re1, double* im1, size_t n, const complex<double>* m) {
+	const double* md = reinterpret_cast<const double*>(m);
+
+	__m256d m0r = _mm256_set1_pd(md[0]), m0i = _mm256_set1_pd(md[1]);
+	__m256d m1r = _mm256_set1_pd(md[2]), m1i = _mm256_set1_pd(md[3]);
+	__m256d m2r = _mm256_set1_pd(md[4]), m2i = _mm256_set1_pd(md[5]);
+	__m256d m3r = _mm256_set1_pd(md[6]), m3i = _mm256_set1_pd(md[7]);
+
+	size_t j = 0;
+	for (; j + 4 <= n; j += 4) {
+		__m256d ar = _mm256_loadu_pd(re0 + j), ai = _mm256_loadu_pd(im0 + j);
+		__m256d br = _mm256_loadu_pd(re1 + j), bi = _mm256_loadu_pd(im1 + j);
+
+		_mm256_storeu_pd(re0 + j, _mm256_fmadd_pd(m1r, br, _mm256_fnmadd_pd(m1i, bi, _mm256_fnmadd_pd(m0i, ai, _mm256_mul_pd(m0r, ar)))));
+		_mm256_storeu_pd(im0 + j, _mm256_fmadd_pd(m1r, bi, _mm256_fmadd_pd(m1i, br, _mm256_fmadd_pd(m0i, ar, _mm256_mul_pd(m0r, ai)))));
+		_mm256_storeu_pd(re1 + j, _mm256_fmadd_pd(m3r, br, _mm256_fnmadd_pd(m3i, bi, _mm256_fnmadd_pd(m2i, ai, _mm256_mul_pd(m2r, ar)))));
+		_mm256_storeu_pd(im1 + j, _mm256_fmadd_pd(m3r, bi, _mm256_fmadd_pd(m3i, br, _mm256_fmadd_pd(m2i, ar, _mm256_mul_pd(m2r, ai)))));
+	}
+
+	split_update(re0 + j, im0 + j, re1 + j, im1 + j, n - j, 1, md);
+}
+
+static void low_split_avx2(double* re, double* im, size_t n, const complex<double>* m) {
+	const double* md = reinterpret_cast<const double*>(m);
+
+	//coefficients of the amplitude of each lane (m0 for the first of a pair, m3 for the second) and of its partner
+	__m256d xr = _mm256_setr_pd(md[0], md[6], md[0], md[6]), xi = _mm256_setr_pd(md[1], md[7], md[1], md[7]);
+	__m256d yr = _mm256_setr_pd(md[2], md[4], md[2], md[4]), yi = _mm256_setr_pd(md[3], md[5], md[3], md[5]);
+
+	size_t j = 0;
+	for (; j + 2 <= n; j += 2) {
+		__m256d ar = _mm256_loadu_pd(re + 2 * j), ai = _mm256_loadu_pd(im + 2 * j);
+		__m256d br = _mm256_permute_pd(ar, 0x5), bi = _mm256_permute_pd(ai, 0x5);
+
+		_mm256_storeu_pd(re + 2 * j, _mm256_fnmadd_pd(yi, bi, _mm256_fmadd_pd(yr, br, _mm256_fnmadd_pd(xi, ai, _mm256_mul_pd(xr, ar)))));
+		_mm256_storeu_pd(im + 2 * j, _mm256_fmadd_pd(yi, br, _mm256_fmadd_pd(yr, bi, _mm256_fmadd_pd(xi, ar, _mm256_mul_pd(xr, ai)))));
+	}
+
+	split_update(re + 2 * j, im + 2 * j, re + 2 * j + 1, im + 2 * j + 1, n - j, 2, md);
+}
+
+static void scale_split_avx2(double* re, double* im, size_t n, const complex<double>* c) {
+	const double* cd = reinterpret_cast<const double*>(c);
+
+	__m256d cr = _mm256_set1_pd(cd[0]), ci = _mm256_set1_pd(cd[1]);
+
+	size_t j = 0;
+	for (; j + 4 <= n; j += 4) {
+		__m256d ar = _mm256_loadu_pd(re + j), ai = _mm256_loadu_pd(im + j);
+		_mm256_storeu_pd(re + j, _mm256_fnmadd_pd(ci, ai, _mm256_mul_pd(cr, ar)));
+		_mm256_storeu_pd(im + j, _mm256_fmadd_pd(ci, ar, _mm256_mul_pd(cr, ai)));
+	}
+
+	split_multiply(re + j, im + j, n - j, 1, cd);
+}
+
+static void diagonal_low_split_avx2(double* re, double* im, size_t n, const complex<double>* d) {
+	const double* dd = reinterpret_cast<const double*>(d);
+
+	//d[0] for the first amplitude of each pair, d[1] for the second
+	__m256d dr = _mm256_setr_pd(dd[0], dd[2], dd[0], dd[2]), di = _mm256_setr_pd(dd[1], dd[3], dd[1], dd[3]);
+
+	size_t j = 0;
+	for (; j + 2 <= n; j += 2) {
+		__m256d ar = _mm256_loadu_pd(re + 2 * j), ai = _mm256_loadu_pd(im + 2 * j);
+		_mm256_storeu_pd(re + 2 * j, _mm256_fnmadd_pd(di, ai, _mm256_mul_pd(dr, ar)));
+		_mm256_storeu_pd(im + 2 * j, _mm256_fmadd_pd(di, ar, _mm256_mul_pd(dr, ai)));
+	}
+
+	split_multiply(re + 2 * j, im + 2 * j, n - j, 2, dd);
+	split_multiply(re + 2 * j + 1, im + 2 * j + 1, n - j, 2, dd + 2);
+}
+
+const kernels::split_kernel_set<double> kernels::avx2_split = {
+	"avx2", high_split_avx2, low_split_avx2, scale_split_avx2, diagonal_low_split_avx2
+};
+
+static void high_split_avx2_float(float* re0, float* im0, float* re1, float* im1, size_t n, const complex<float>* m) {
+	const float* md = reinterpret_cast<const float*>(m);
+
+	__m256 m0r = _mm256_set1_ps(md[0]), m0i = _mm256_set1_ps(md[1]);
+	__m256 m1r = _mm256_set1_ps(md[2]), m1i = _mm256_set1_ps(md[3]);
+	__m256 m2r = _mm256_set1_ps(md[4]), m2i = _mm256_set1_ps(md[5]);
+	__m256 m3r = _mm256_set1_ps(md[6]), m3i = _mm256_set1_ps(md[7]);
+
+	size_t j = 0;
+	for (; j + 8 <= n; j += 8) {
+		__m256 ar = _mm256_loadu_ps(re0 + j), ai = _mm256_loadu_ps(im0 + j);
+		__m256 br = _mm256_loadu_ps(re1 + j), bi = _mm256_loadu_ps(im1 + j);
+
+		_mm256_storeu_ps(re0 + j, _mm256_fmadd_ps(m1r, br, _mm256_fnmadd_ps(m1i, bi, _mm256_fnmadd_ps(m0i, ai, _mm256_mul_ps(m0r, ar)))));
+		_mm256_storeu_ps(im0 + j, _mm256_fmadd_ps(m1r, bi, _mm256_fmadd_ps(m1i, br, _mm256_fmadd_ps(m0i, ar, _mm256_mul_ps(m0r, ai)))));
+		_mm256_storeu_ps(re1 + j, _mm256_fmadd_ps(m3r, br, _mm256_fnmadd_ps(m3i, bi, _mm256_fnmadd_ps(m2i, ai, _mm256_mul_ps(m2r, ar)))));
+		_mm256_storeu_ps(im1 + j, _mm256_fmadd_ps(m3r, bi, _mm256_fmadd_ps(m3i, br, _mm256_fmadd_ps(m2i, ar, _mm256_mul_ps(m2r, ai)))));
+	}
+
+	split_update(re0 + j, im0 + j, re1 + j, im1 + j, n - j, 1, md);
+}
+
+static void low_split_avx2_float(float* re, float* im, size_t n, const complex<float>* m) {
+	const float* md = reinterpret_cast<const float*>(m);
+
+	//coefficients of the amplitude of each lane (m0 for the first of a pair, m3 for the second) and of its partner
+	__m256 xr = _mm256_setr_ps(md[0], md[6], md[0], md[6], md[0], md[6], md[0], md[6]);
+	__m256 xi = _mm256_setr_ps(md[1], md[7], md[1], md[7], md[1], md[7], md[1], md[7]);
+	__m256 yr = _mm256_setr_ps(md[2], md[4], md[2], md[4], md[2], md[4], md[2], md[4]);
+	__m256 yi = _mm256_setr_ps(md[3], md[5], md[3], md[5], md[3], md[5], md[3], md[5]);
+
+	size_t j = 0;
+	for (; j + 4 <= n; j += 4) {
+		__m256 ar = _mm256_loadu_ps(re + 2 * j), ai = _mm256_loadu_ps(im + 2 * j);
+		__m256 br = _mm256_permute_ps(ar, 0xb1), bi = _mm256_permute_ps(ai, 0xb1);
+
+		_mm256_storeu_ps(re + 2 * j, _mm256_fnmadd_ps(yi, bi, _mm256_fmadd_ps(yr, br, _mm256_fnmadd_ps(xi, ai, _mm256_mul_ps(xr, ar)))));
+		_mm256_storeu_ps(im + 2 * j, _mm256_fmadd_ps(yi, br, _mm256_fmadd_ps(yr, bi, _mm256_fmadd_ps(xi, ar, _mm256_mul_ps(xr, ai)))));
+	}
+
+	split_update(re + 2 * j, im + 2 * j, re + 2 * j + 1, im + 2 * j + 1, n - j, 2, md);
+}
+
+static void scale_split_avx2_float(float* re, float* im, size_t n, const complex<float>* c) {
+	const float* cd = reinterpret_cast<const float*>(c);
+
+	__m256 cr = _mm256_set1_ps(cd[0]), ci = _mm256_set1_ps(cd[1]);
+
+	size_t j = 0;
+	for (; j + 8 <= n; j += 8) {
+		__m256 ar = _mm256_loadu_ps(re + j), ai = _mm256_loadu_ps(im + j);
+		_mm256_storeu_ps(re + j, _mm256_fnmadd_ps(ci, ai, _mm256_mul_ps(cr, ar)));
+		_mm256_storeu_ps(im + j, _mm256_fmadd_ps(ci, ar, _mm256_mul_ps(cr, ai)));
+	}
+
+	split_multiply(re + j, im + j, n - j, 1, cd);
+}
+
+static void diagonal_low_split_avx2_float(float* re, float* im, size_t n, const complex<float>* d) {
+	const float* dd = reinterpret_cast<const float*>(d);
+
+	//d[0] for the first amplitude of each pair, d[1] for the second
+	__m256 dr = _mm256_setr_ps(dd[0], dd[2], dd[0], dd[2], dd[0], dd[2], dd[0], dd[2]);
+	__m256 di = _mm256_setr_ps(dd[1], dd[3], dd[1], dd[3], dd[1], dd[3], dd[1], dd[3]);
+
+	size_t j = 0;
+	for (; j + 4 <= n; j += 4) {
+		__m256 ar = _mm256_loadu_ps(re + 2 * j), ai = _mm256_loadu_ps(im + 2 * j);
+		_mm256_storeu_ps(re + 2 * j, _mm256_fnmadd_ps(di, ai, _mm256_mul_ps(dr, ar)));
+		_mm256_storeu_ps(im + 2 * j, _mm256_fmadd_ps(di, ar, _mm256_mul_ps(dr, ai)));
+	}
+
+	split_multiply(re + 2 * j, im + 2 * j, n - j, 2, dd);
+	split_multiply(re + 2 * j + 1, im + 2 * j + 1, n - j, 2, dd + 2);
+}
+
+const kernels::split_kernel_set<float> kernels::avx2_split_float = {
+	"avx2", high_split_avx2_float, low_split_avx2_float, scale_split_avx2_float, diagonal_low_split_avx2_float
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+
+//scalar loops shared by the kernel files: the split kernels of the scalar set, and the tails of the vectorized sets
+//past their last full register. they are static, so that each file compiles a copy of its own with its own target
+//flags (the linker could otherwise keep the copy compiled for avx2 or avx-512 for all files).
+
+//updates the pair of interleaved amplitudes (x0[0] + i x0[1], x1[0] + i x1[1]) by m, where m[2k], m[2k + 1] are the
+//parts of entry k
+template<typename T>
+static inline void pair_tail(T* x0, T* x1, const T* m) {
+	T a0r = x0[0], a0i = x0[1], a1r = x1[0], a1i = x1[1];
+	x0[0] = m[0] * a0r - m[1] * a0i + m[2] * a1r - m[3] * a1i;
+	x0[1] = m[0] * a0i + m[1] * a0r + m[2] * a1i + m[3] * a1r;
+	x1[0] = m[4] * a0r - m[5] * a0i + m[6] * a1r - m[7] * a1i;
+	x1[1] = m[4] * a0i + m[5] * a0r + m[6] * a1i + m[7] * a1r;
+}
+
+//updates pairs (re0[j step] + i im0[j step], re1[j step] + i im1[j step]) for j in [0, n) by m,
+//where m[2k], m[2k + 1] are the parts of entry k
+template<typename T>
+static void split_update(T* re0, T* im0, T* re1, T* im1, size_t n, size_t step, const T* m) {
+	T m0r = m[0], m0i = m[1], m1r = m[2], m1i = m[3];
+	T m2r = m[4], m2i = m[5], m3r = m[6], m3i = m[7];
+
+	for (size_t j = 0; j < n * step; j += step) {
+		T ar = re0[j], ai = im0[j], br = re1[j], bi = im1[j];
+		re0[j] = m0r * ar - m0i * ai + m1r * br - m1i * bi;
+		im0[j] = m0r * ai + m0i * ar + m1r * bi + m1i * br;
+		re1[j] = m2r * ar - m2i * ai + m3r * br - m3i * bi;
+		im1[j] = m2r * ai + m2i * ar + m3r * bi + m3i * br;
+	}
+}
+
+//multiplies amplitudes re[j step] + i im[j step] for j in [0, n) by c = (c[0], c[1])
+template<typename T>
+static void split_multiply(T* re, T* im, size_t n, size_t step, const T* c) {
+	T cr = c[0], ci = c[1];
+
+	for (size_t j = 0; j < n * step; j += step) {
+		T ar = re[j], ai = im[j];
+		re[j] = cr * ar - ci * ai;
+		im[j] = cr * ai + ci * ar;
+	}
+}
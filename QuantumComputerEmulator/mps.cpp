@@ -0,0 +1,527 @@
+#include "mps.h"
+#include "random.h"
+#include <complex>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+//singular value decomposition a = u diag(s) vh of rows x cols matrix a (row-major), by one-sided Jacobi rotations
+//orthogonalizing the columns of a (or of its adjoint if a has more columns than rows). for n = min(rows, cols),
+//u is rows x n, s holds n descending values and vh is n x cols.
+static void svd(const vector<complex<double>>& a, size_t rows, size_t cols,
+	vector<complex<double>>& u, vector<double>& s, vector<complex<double>>& vh) {
+	bool adjoint = cols > rows;
+	size_t m = adjoint ? cols : rows;
+	size_t n = adjoint ? rows : cols;
+
+	//columns w_j (contiguous) of a or its adjoint, rotated together with those of v, so that w = a v throughout
+	vector<complex<double>> w(n * m), v(n * n, 0);
+	for (size_t i = 0; i < rows; i++) {
+		for (size_t j = 0; j < cols; j++) {
+			if (adjoint) w[i * m + j] = conj(a[i * cols + j]);
+			else w[j * m + i] = a[i * cols + j];
+		}
+	}
+	for (size_t j = 0; j < n; j++) v[j * n + j] = 1;
+
+	const double eps = 1e-15;
+	for (int sweep = 0; sweep < 64; sweep++) {
+		bool rotated = false;
+		for (size_t p = 0; p + 1 < n; p++) {
+			for (size_t q = p + 1; q < n; q++) {
+				complex<double>* wp = &w[p * m];
+				complex<double>* wq = &w[q * m];
+				double alpha = 0, beta = 0;
+				complex<double> gamma = 0;
+				for (size_t i = 0; i < m; i++) {
+					alpha += norm(wp[i]);
+					beta += norm(wq[i]);
+					gamma += conj(wp[i]) * wq[i];
+				}
+				double g = abs(gamma);
+				if (g == 0 || g <= eps * sqrt(alpha * beta)) continue;
+				rotated = true;
+
+				//rotation making columns p and q orthogonal, once the phase of their product is taken out of q
+				complex<double> phase = conj(gamma / g);
+				double zeta = (beta - alpha) / (2 * g);
+				double t = ((zeta >= 0) ? 1 : -1) / (abs(zeta) + sqrt(1 + zeta * zeta));
+				double c = 1 / sqrt(1 + t * t);
+				double sn = c * t;
+				for (size_t i = 0; i < m; i++) {
+					complex<double> x = wp[i], y = wq[i] * phase;
+					wp[i] = c * x - sn * y;
+					wq[i] = sn * x + c * y;
+				}
+				complex<double>* vp = &v[p * n];
+				complex<double>* vq = &v[q * n];
+				for (size_t i = 0; i < n; i++) {
+					complex<double> x = vp[i], y = vq[i] * phase;
+					vp[i] = c * x - sn * y;
+					vq[i] = sn * x + c * y;
+				}
+			}
+		}
+		if (!rotated) break;
+	}
+
+	//singular values are the norms of the columns, in descending order
+	vector<double> sigma(n);
+	for (size_t j = 0; j < n; j++) {
+		double sum = 0;
+		for (size_t i = 0; i < m; i++) sum += norm(w[j * m + i]);
+		sigma[j] = sqrt(sum);
+	}
+	vector<size_t> order(n);
+	iota(order.begin(), order.end(), 0);
+	sort(order.begin(), order.end(), [&sigma](size_t x, size_t y) { return sigma[x] > sigma[y]; });
+
+	//a v = w = u' diag(s) gives a = u' diag(s) v^H, and the adjoint of a decomposed so gives a = v diag(s) u'^H
+	u.assign(rows * n, 0);
+	vh.assign(n * cols, 0);
+	s.resize(n);
+	for (size_t k = 0; k < n; k++) {
+		size_t j = order[k];
+		s[k] = sigma[j];
+		double scale = (sigma[j] > 0) ? 1 / sigma[j] : 0;
+		if (adjoint) {
+			for (size_t i = 0; i < rows; i++) u[i * n + k] = v[j * n + i];
+			for (size_t i = 0; i < cols; i++) vh[k * cols + i] = conj(w[j * m + i]) * scale;
+		}
+		else {
+			for (size_t i = 0; i < rows; i++) u[i * n + k] = w[j * m + i] * scale;
+			for (size_t i = 0; i < cols; i++) vh[k * cols + i] = conj(v[j * n + i]);
+		}
+	}
+}
+
+MpsRegistry::MpsRegistry(unsigned int size, unsigned int max_bond, double threshold)
+	: Registry(size), max_bond_(max(max_bond, 1u)), threshold_(threshold) {
+	reset();
+}
+
+void MpsRegistry::reset() {
+	sites_.assign(size_, site{ 1, 1, { 1, 0 } });
+	qubit_.resize(size_);
+	site_.resize(size_);
+	iota(qubit_.begin(), qubit_.end(), 0);
+	iota(site_.begin(), site_.end(), 0);
+	center_ = 0;
+	fidelity_ = 1;
+	bond_ = 1;
+}
+
+void MpsRegistry::assign(const vector<unsigned char>& value) {
+	for (unsigned int s = 0; s < size_; s++) {
+		sites_[s] = site{ 1, 1, { 0, 0 } };
+		sites_[s].a[value[qubit_[s]]] = 1;
+	}
+	center_ = 0;
+}
+
+size_t MpsRegistry::keep(vector<double>& s, bool truncate) {
+	double total = 0;
+	for (double x : s) total += x * x;
+
+	//singular values vanishing up to rounding carry nothing of the state
+	size_t kept = s.size();
+	double dropped = 0;
+	auto drop = [&]() { kept--; dropped += s[kept] * s[kept]; };
+	while (kept > 1 && s[kept - 1] * s[kept - 1] <= 1e-24 * total) drop();
+
+	if (truncate) {
+		while (kept > max_bond_) drop();
+		while (kept > 1 && dropped + s[kept - 1] * s[kept - 1] <= threshold_ * total) drop();
+		fidelity_ *= 1 - dropped / total;
+	}
+
+	double scale = 1 / sqrt(total - dropped);
+	for (size_t k = 0; k < kept; k++) s[k] *= scale;
+	return kept;
+}
+
+void MpsRegistry::move_center(unsigned int s) {
+	vector<complex<double>> u, vh;
+	vector<double> sv;
+
+	//the center site is split into a normalized site and the rest, which moves into the next site
+	while (center_ < s) {
+		site& a = sites_[center_];
+		site& b = sites_[center_ + 1];
+		svd(a.a, a.left * 2, a.right, u, sv, vh);
+		size_t n = sv.size();
+		size_t k = keep(sv, false);
+
+		vector<complex<double>> left(a.left * 2 * k);
+		for (size_t i = 0; i < a.left * 2; i++) copy(&u[i * n], &u[i * n] + k, &left[i * k]);
+
+		vector<complex<double>> right(k * 2 * b.right, 0);
+		for (size_t i = 0; i < k; i++) {
+			for (size_t j = 0; j < a.right; j++) {
+				complex<double> x = sv[i] * vh[i * a.right + j];
+				for (size_t c = 0; c < 2 * b.right; c++) right[i * 2 * b.right + c] += x * b.a[j * 2 * b.right + c];
+			}
+		}
+		a.a.swap(left);
+		a.right = k;
+		b.a.swap(right);
+		b.left = k;
+		center_++;
+	}
+
+	while (center_ > s) {
+		site& a = sites_[center_ - 1];
+		site& b = sites_[center_];
+		svd(b.a, b.left, 2 * b.right, u, sv, vh);
+		size_t n = sv.size();
+		size_t k = keep(sv, false);
+
+		vector<complex<double>> right(vh.begin(), vh.begin() + k * 2 * b.right);
+
+		vector<complex<double>> left(a.left * 2 * k, 0);
+		for (size_t i = 0; i < a.left * 2; i++) {
+			for (size_t j = 0; j < a.right; j++) {
+				complex<double> x = a.a[i * a.right + j];
+				for (size_t c = 0; c < k; c++) left[i * k + c] += x * u[j * n + c] * sv[c];
+			}
+		}
+		b.a.swap(right);
+		b.left = k;
+		a.a.swap(left);
+		a.right = k;
+		center_--;
+	}
+}
+
+void MpsRegistry::apply_sites(unsigned int s, unsigned int k, const complex<double>* m) {
+	move_center(s);
+
+	//theta[(l * d + x) * right + r]: the sites merged, x holding bit k - 1 - j of site s + j
+	size_t left = sites_[s].left;
+	size_t d = (size_t)1 << k;
+	vector<complex<double>> theta = sites_[s].a;
+	size_t right = sites_[s].right;
+	for (unsigned int j = 1; j < k; j++) {
+		const site& b = sites_[s + j];
+		vector<complex<double>> merged(theta.size() / right * 2 * b.right, 0);
+		for (size_t i = 0; i < theta.size() / right; i++) {
+			for (size_t c = 0; c < right; c++) {
+				complex<double> x = theta[i * right + c];
+				if (x == 0.0) continue;
+				for (size_t e = 0; e < 2 * b.right; e++) merged[i * 2 * b.right + e] += x * b.a[c * 2 * b.right + e];
+			}
+		}
+		theta.swap(merged);
+		right = b.right;
+	}
+
+	vector<complex<double>> applied(theta.size(), 0);
+	for (size_t l = 0; l < left; l++) {
+		for (size_t y = 0; y < d; y++) {
+			complex<double>* out = &applied[(l * d + y) * right];
+			for (size_t x = 0; x < d; x++) {
+				complex<double> e = m[y * d + x];
+				if (e == 0.0) continue;
+				const complex<double>* in = &theta[(l * d + x) * right];
+				for (size_t r = 0; r < right; r++) out[r] += e * in[r];
+			}
+		}
+	}
+	theta.swap(applied);
+
+	//split off one site after another from the left: rows are (left bond, bit of the site), columns the rest
+	vector<complex<double>> u, vh;
+	vector<double> sv;
+	for (unsigned int j = 0; j + 1 < k; j++) {
+		size_t rows = left * 2;
+		size_t cols = theta.size() / rows;
+		svd(theta, rows, cols, u, sv, vh);
+		size_t n = sv.size();
+		size_t kept = keep(sv, true);
+
+		site& a = sites_[s + j];
+		a.left = left;
+		a.right = kept;
+		a.a.resize(rows * kept);
+		for (size_t i = 0; i < rows; i++) copy(&u[i * n], &u[i * n] + kept, &a.a[i * kept]);
+
+		theta.resize(kept * cols);
+		for (size_t i = 0; i < kept; i++) {
+			for (size_t c = 0; c < cols; c++) theta[i * cols + c] = sv[i] * vh[i * cols + c];
+		}
+		left = kept;
+		bond_ = max(bond_, kept);
+	}
+	site& last = sites_[s + k - 1];
+	last.left = left;
+	last.right = right;
+	last.a.swap(theta);
+	center_ = s + k - 1;
+}
+
+void MpsRegistry::swap_sites(unsigned int s) {
+	complex<double> m[16];
+	SwapInstruction(0, 1).matrix(m);
+	apply_sites(s, 2, m);
+
+	swap(qubit_[s], qubit_[s + 1]);
+	site_[qubit_[s]] = s;
+	site_[qubit_[s + 1]] = s + 1;
+}
+
+complex<double> MpsRegistry::amplitude(size_t i) const {
+	//product of the matrices of the bits of state i, from the left
+	vector<complex<double>> v(1, 1);
+	for (unsigned int s = 0; s < size_; s++) {
+		const site& a = sites_[s];
+		unsigned int q = qubit_[s];
+		size_t b = (q < 64) ? (i >> q) & 1 : 0;
+		vector<complex<double>> next(a.right, 0);
+		for (size_t l = 0; l < a.left; l++) {
+			for (size_t r = 0; r < a.right; r++) next[r] += v[l] * a.a[(l * 2 + b) * a.right + r];
+		}
+		v.swap(next);
+	}
+	return v[0];
+}
+
+bool MpsRegistry::measure(unsigned int i) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+
+	//at the center, probabilities of the qubit are those of its site alone
+	unsigned int s = site_[i];
+	move_center(s);
+	site& a = sites_[s];
+	double p1 = 0;
+	for (size_t l = 0; l < a.left; l++) {
+		for (size_t r = 0; r < a.right; r++) p1 += norm(a.a[(l * 2 + 1) * a.right + r]);
+	}
+
+	bool value = p1 >= 1 || rng::local().uniform() < p1;
+
+	double scale = 1 / sqrt(value ? p1 : 1 - p1);
+	for (size_t l = 0; l < a.left; l++) {
+		for (size_t b = 0; b < 2; b++) {
+			for (size_t r = 0; r < a.right; r++) a.a[(l * 2 + b) * a.right + r] *= (b == (size_t)value) ? scale : 0;
+		}
+	}
+	return value;
+}
+
+void MpsRegistry::draw(vector<unsigned char>& value) const {
+	//conditional probabilities of each site's bit given those drawn left of it are the norms of the rows reached,
+	//as the sites right of it are right-normalized
+	rng::generator& generator = rng::local();
+	vector<complex<double>> v(1, 1), w[2];
+	for (unsigned int s = 0; s < size_; s++) {
+		const site& a = sites_[s];
+		double p[2] = { 0, 0 };
+		for (size_t b = 0; b < 2; b++) {
+			w[b].assign(a.right, 0);
+			for (size_t l = 0; l < a.left; l++) {
+				for (size_t r = 0; r < a.right; r++) w[b][r] += v[l] * a.a[(l * 2 + b) * a.right + r];
+			}
+			for (const complex<double>& x : w[b]) p[b] += norm(x);
+		}
+		size_t b = (generator.uniform() * (p[0] + p[1]) < p[0]) ? 0 : 1;
+		value[qubit_[s]] = (unsigned char)b;
+		double scale = 1 / sqrt(p[b]);
+		v.resize(a.right);
+		for (size_t r = 0; r < a.right; r++) v[r] = w[b][r] * scale;
+	}
+}
+
+template<typename F>
+void MpsRegistry::sample(size_t shots, const F& f) const {
+	MpsRegistry normalized(*this);
+	normalized.move_center(0);
+
+	vector<unsigned char> value(size_);
+	for (size_t j = 0; j < shots; j++) {
+		normalized.draw(value);
+		f(value);
+	}
+}
+
+uint64_t MpsRegistry::measure_all() {
+	if (size_ > 64) throw runtime_error("error: value of registry of more than 64 qubits does not fit in 64 bits");
+
+	move_center(0);
+	vector<unsigned char> value(size_);
+	draw(value);
+	assign(value);
+
+	uint64_t val = 0;
+	for (unsigned int q = 0; q < size_; q++) val |= (uint64_t)value[q] << q;
+	return val;
+}
+
+string MpsRegistry::measure_bits() {
+	move_center(0);
+	vector<unsigned char> value(size_);
+	draw(value);
+	assign(value);
+
+	string bits(size_, '0');
+	for (unsigned int q = 0; q < size_; q++) if (value[q]) bits[size_ - 1 - q] = '1';
+	return bits;
+}
+
+map<uint64_t, size_t> MpsRegistry::sample(size_t shots) const {
+	if (size_ > 64) throw runtime_error("error: value of registry of more than 64 qubits does not fit in 64 bits");
+
+	map<uint64_t, size_t> counts;
+	sample(shots, [this, &counts](const vector<unsigned char>& value) {
+		uint64_t val = 0;
+		for (unsigned int q = 0; q < size_; q++) val |= (uint64_t)value[q] << q;
+		counts[val]++;
+	});
+	return counts;
+}
+
+map<string, size_t> MpsRegistry::sample_bits(size_t shots) const {
+	map<string, size_t> counts;
+	sample(shots, [this, &counts](const vector<unsigned char>& value) {
+		string bits(size_, '0');
+		for (unsigned int q = 0; q < size_; q++) if (value[q]) bits[size_ - 1 - q] = '1';
+		counts[bits]++;
+	});
+	return counts;
+}
+
+void MpsRegistry::apply(unsigned int target, const complex<double>* m) {
+	if (target >= size_) throw runtime_error("registry not large enough");
+
+	//a 1-qubit gate acts on its site alone, and keeps it normalized
+	site& a = sites_[site_[target]];
+	for (size_t l = 0; l < a.left; l++) {
+		complex<double>* a0 = &a.a[(l * 2) * a.right];
+		complex<double>* a1 = &a.a[(l * 2 + 1) * a.right];
+		for (size_t r = 0; r < a.right; r++) {
+			complex<double> x = a0[r], y = a1[r];
+			a0[r] = m[0] * x + m[1] * y;
+			a1[r] = m[2] * x + m[3] * y;
+		}
+	}
+}
+
+void MpsRegistry::apply_controlled(unsigned int control, unsigned int target, const complex<double>* m) {
+	//bit 0 of indices is control, bit 1 is target: identity unless control is 1
+	complex<double> cm[16] = {};
+	cm[0 * 4 + 0] = 1;
+	cm[2 * 4 + 2] = 1;
+	for (int r = 0; r < 2; r++) {
+		for (int c = 0; c < 2; c++) cm[(1 | r << 1) * 4 + (1 | c << 1)] = m[r * 2 + c];
+	}
+	apply_unitary({ control, target }, cm);
+}
+
+void MpsRegistry::apply_unitary(const vector<unsigned int>& qubits, const complex<double>* m) {
+	if (qubits.size() > max_unitary_qubits) throw runtime_error("error: unitary on too many qubits");
+	for (unsigned int q : qubits) if (q >= size_) throw runtime_error("registry not large enough");
+	if (qubits.size() == 1) return apply(qubits[0], m);
+
+	//the sites of the qubits are made neighbours of the leftmost one by swaps of neighbouring sites
+	unsigned int k = (unsigned int)qubits.size();
+	vector<unsigned int> sites;
+	for (unsigned int q : qubits) sites.push_back(site_[q]);
+	sort(sites.begin(), sites.end());
+	for (unsigned int j = 1; j < k; j++) {
+		while (sites[j] > sites[j - 1] + 1) swap_sites(--sites[j]);
+	}
+	unsigned int s = sites[0];
+
+	//bit k - 1 - t of the indices of apply_sites is bit j of those of m, for the qubit j of site s + t
+	vector<unsigned int> bit(k);
+	for (unsigned int t = 0; t < k; t++) {
+		unsigned int j = (unsigned int)(find(qubits.begin(), qubits.end(), qubit_[s + t]) - qubits.begin());
+		bit[k - 1 - t] = j;
+	}
+	size_t d = (size_t)1 << k;
+	vector<size_t> index(d, 0);
+	for (size_t x = 0; x < d; x++) {
+		for (unsigned int p = 0; p < k; p++) if ((x >> p) & 1) index[x] |= (size_t)1 << bit[p];
+	}
+	vector<complex<double>> ms(d * d);
+	for (size_t y = 0; y < d; y++) {
+		for (size_t x = 0; x < d; x++) ms[y * d + x] = m[index[y] * d + index[x]];
+	}
+	apply_sites(s, k, ms.data());
+}
+
+void MpsRegistry::swap_qubits(const vector<pair<unsigned int, unsigned int>>& pairs) {
+	for (const pair<unsigned int, unsigned int>& p : pairs) {
+		swap(site_[p.first], site_[p.second]);
+		qubit_[site_[p.first]] = p.first;
+		qubit_[site_[p.second]] = p.second;
+	}
+}
+
+void MpsRegistry::reduced(unsigned int i, complex<double>* rho) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+
+	//at the center, the other sites contract to identities
+	move_center(site_[i]);
+	const site& a = sites_[center_];
+	fill(rho, rho + 4, complex<double>(0));
+	for (size_t l = 0; l < a.left; l++) {
+		for (size_t r = 0; r < a.right; r++) {
+			for (size_t b = 0; b < 2; b++) {
+				for (size_t c = 0; c < 2; c++) rho[b * 2 + c] += a.a[(l * 2 + b) * a.right + r] * conj(a.a[(l * 2 + c) * a.right + r]);
+			}
+		}
+	}
+}
+
+double MpsRegistry::pauli_expectation(uint64_t flip, uint64_t sign, unsigned int) const {
+	const complex<double> i(0, 1);
+
+	//e[c * left + l] contracts the sites left of the current one, c indexing the bond of the conjugate state
+	vector<complex<double>> e(1, 1);
+	for (unsigned int s = 0; s < size_; s++) {
+		const site& a = sites_[s];
+		unsigned int q = qubit_[s];
+		bool x = q < 64 && ((flip >> q) & 1) != 0;
+		bool z = q < 64 && ((sign >> q) & 1) != 0;
+
+		//Pauli of qubit q (row-major): I, X, Z or Y (the factors i of Y in its entries)
+		complex<double> m[4] = { 1, 0, 0, 1 };
+		if (x && z) {
+			m[0] = 0; m[1] = -i; m[2] = i; m[3] = 0;
+		}
+		else if (x) {
+			m[0] = 0; m[1] = 1; m[2] = 1; m[3] = 0;
+		}
+		else if (z) m[3] = -1;
+
+		//t[(c * 2 + b) * right + r]: e times the tensor of the site, then the Pauli applied to bit b
+		vector<complex<double>> t(a.left * 2 * a.right, 0);
+		for (size_t c = 0; c < a.left; c++) {
+			for (size_t l = 0; l < a.left; l++) {
+				complex<double> w = e[c * a.left + l];
+				if (w == 0.0) continue;
+				for (size_t k = 0; k < 2 * a.right; k++) t[c * 2 * a.right + k] += w * a.a[l * 2 * a.right + k];
+			}
+			for (size_t r = 0; r < a.right; r++) {
+				complex<double> t0 = t[(c * 2) * a.right + r], t1 = t[(c * 2 + 1) * a.right + r];
+				t[(c * 2) * a.right + r] = m[0] * t0 + m[1] * t1;
+				t[(c * 2 + 1) * a.right + r] = m[2] * t0 + m[3] * t1;
+			}
+		}
+
+		//closed with the conjugate tensor over the left bond and the bit
+		vector<complex<double>> next(a.right * a.right, 0);
+		for (size_t k = 0; k < a.left * 2; k++) {
+			for (size_t c = 0; c < a.right; c++) {
+				complex<double> w = conj(a.a[k * a.right + c]);
+				if (w == 0.0) continue;
+				for (size_t r = 0; r < a.right; r++) next[c * a.right + r] += w * t[k * a.right + r];
+			}
+		}
+		e.swap(next);
+	}
+	return e[0].real();
+}
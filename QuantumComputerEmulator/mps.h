@@ -0,0 +1,105 @@
+#pragma once
+#include "quantum.h"
+#include <string>
+
+//state of a registry as a matrix product state: a chain of tensors (sites), each holding one qubit and joined to its
+//neighbours by bonds of dimension at most max_bond. a gate on qubits of neighbouring sites merges them and splits
+//them again by a singular value decomposition, dropping the smallest singular values, so circuits creating little
+//entanglement run on hundreds of qubits in memory and time polynomial in their size. the weight of the dropped
+//singular values makes up the truncation error. amplitudes are held in double precision.
+class MpsRegistry : public Registry {
+private:
+	//tensor of left x 2 x right amplitudes, a[(l * 2 + b) * right + r] for bit b of its qubit
+	struct site {
+		size_t left;
+		size_t right;
+		std::vector<std::complex<double>> a;
+	};
+
+	std::vector<site> sites_;
+
+	//qubit held by each site and site of each qubit: swaps of qubits exchange their sites, not amplitudes
+	std::vector<unsigned int> qubit_;
+	std::vector<unsigned int> site_;
+
+	//sites left of the center are left-normalized and sites right of it right-normalized, so the norm of the
+	//state is that of the center site
+	unsigned int center_;
+
+	unsigned int max_bond_;
+
+	//largest weight (fraction of the norm) of the singular values dropped together at a split
+	double threshold_;
+
+	//product of 1 - weight dropped over all splits, the fidelity of the state to the exact state
+	double fidelity_;
+
+	//largest bond dimension reached
+	size_t bond_;
+
+	//number of the descending singular values s kept at a split: those not vanishing up to rounding, and if
+	//truncate, no more than max_bond_ and not those of weight below threshold_. rescales the kept values to
+	//norm 1, and accounts the weight dropped by truncation in fidelity_.
+	size_t keep(std::vector<double>& s, bool truncate);
+
+	//moves the center to site s
+	void move_center(unsigned int s);
+
+	//applies 2^k x 2^k matrix m to the qubits of sites s to s + k - 1, site s + j being bit k - 1 - j of its
+	//indices, and leaves the center at site s + k - 1
+	void apply_sites(unsigned int s, unsigned int k, const std::complex<double>* m);
+
+	//exchanges the qubits of sites s and s + 1
+	void swap_sites(unsigned int s);
+
+	//draws a value of each qubit from the state (center at site 0), without changing it. value[q] is that of qubit q.
+	void draw(std::vector<unsigned char>& value) const;
+
+	//calls f(value) with the values of shots draws (see draw)
+	template<typename F>
+	void sample(size_t shots, const F& f) const;
+
+	//sets registry to the basis state of given qubit values
+	void assign(const std::vector<unsigned char>& value);
+
+public:
+	//constructs registry of given size in state |0...0>, keeping bonds of at most max_bond dimensions and dropping
+	//singular values of total weight up to threshold at each split
+	MpsRegistry(unsigned int size, unsigned int max_bond, double threshold = 0);
+
+	//1 - fidelity of the state to the one an exact simulation would give (estimated from the dropped weights)
+	double truncation_error() const { return 1 - fidelity_; }
+
+	//largest bond dimension reached
+	size_t bond() const { return bond_; }
+
+	void reset() override;
+
+	std::complex<double> amplitude(size_t i) const override;
+
+	bool measure(unsigned int i) override;
+
+	//throws runtime_error for registries of more than 64 qubits, whose values are given by measure_bits
+	uint64_t measure_all() override;
+
+	std::string measure_bits() override;
+
+	std::map<uint64_t, size_t> sample(size_t shots) const override;
+
+	std::map<std::string, size_t> sample_bits(size_t shots) const override;
+
+	void apply(unsigned int target, const std::complex<double>* m) override;
+
+	void apply_controlled(unsigned int control, unsigned int target, const std::complex<double>* m) override;
+
+	void apply_unitary(const std::vector<unsigned int>& qubits, const std::complex<double>* m) override;
+
+	void swap_qubits(const std::vector<std::pair<unsigned int, unsigned int>>& pairs) override;
+
+	//moves the center to the site of qubit i
+	void reduced(unsigned int i, std::complex<double>* rho) override;
+
+	//contracts the chain from the left with the Pauli of each qubit between the state and its conjugate, in time
+	//linear in size and cubic in the bond dimension
+	double pauli_expectation(uint64_t flip, uint64_t sign, unsigned int ys) const override;
+};
@@ -1,27 +1,61 @@
 #include "quantum.h"
 #include "myqasm_interpreter.h"
 #include "gates.h"
+#include "parallel.h"
+#include "kernels.h"
+#include "benchmark.h"
+#include "random.h"
+#include "cluster.h"
+#include "mps.h"
+#include "noise.h"
+#include "circuit.h"
+#include "parser.h"
+#include "sweep.h"
 #include <iostream>
 #include <ctime>
 #include <string>
 #include <unordered_map>
 #include <set>
 #include <fstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <sstream>
+#include <algorithm>
 
 using namespace std;
 
 unordered_map<string, qasm::gate*> gates;
 
-extern QRegistry* registry = nullptr;
+extern Registry* registry = nullptr;
+
+//routine being compiled from a file. while set, gate instructions are appended to it instead of applied to registry.
+Routine* program = nullptr;
+
+//channels appended after the gates of compiled files
+NoiseModel noise;
+
+//noise channels are drawn as trajectories of state vectors, rather than applied to density matrices
+bool trajectories = false;
+
+//gates defined are echoed, unless a streamed file is read again
+bool echo_gates = true;
+
+//instructions read per batch of a file run as it is read, 0 to compile files whole before running them
+size_t stream_batch = 0;
+
+//routines compiled by compile_file, by file name
+unordered_map<string, unique_ptr<Routine>> compiled;
 
 extern complex<double> consts::i(0, 1);
 
 extern double consts::pi = 3.14159265;
 
 int main(int argc, char* argv[]) {
-	//generate random seed
-	srand(time(0));
-	rand();
+	//random seed, unless one is given
+	rng::seed((uint64_t)time(0));
 
 	//define names of built-in gates
 	gates.emplace("Rx", &Rx);
@@ -33,134 +67,686 @@ int main(int argc, char* argv[]) {
 	gates.emplace("Ph", &Ph);
 	gates.emplace("T", &T);
 	gates.emplace("Tdag", &Tdag);
+	gates.emplace("CCNOT", &CCNot);
+	gates.emplace("MCX", &MCX);
 
 	//check command line arguments: 
-	//valid arguments should be one integral value representing size of quantum registry (between 2 & 8)
-	if (argc != 2) {
-		cout << "Usage: myqasm <size> | myqasm <filename> " << endl;
+	//options, followed by one integral value representing size of quantum registry (at least 2) or a file name
+	const string usage = "Usage: myqasm [options] <size> | myqasm [options] <filename>\n"
+		"Options: --memory <MiB>  largest state vector to allocate\n"
+		"         --threads <n>   threads applying each gate (0 for all hardware threads)\n"
+		"         --kernels <set> vector instructions used by gates (scalar, avx2 or avx512)\n"
+		"         --precision <p> precision of amplitudes (double or float)\n"
+		"         --layout <l>    storage of amplitudes (interleaved or split real and imaginary parts)\n"
+		"         --fusion <k>    widest unitary that gates of a file are fused into (1 disables fusion)\n"
+		"         --cache <KiB>   chunk of the registry that runs of gates of a file are applied to (0 disables)\n"
+		"         --stream <n>    run files as they are read, in batches of n gates read while the batch before runs\n"
+		"         --stabilizer <s> run files of Clifford gates only (H, CNOT, phase by pi/2, ...) on a tableau (on or off)\n"
+		"         --sparse <f>    fraction of nonzero amplitudes above which a registry stops storing only those (0 disables)\n"
+		"         --mps <chi>     run registries as matrix product states of bond dimension up to chi (0 disables)\n"
+		"         --truncation <w> weight of the singular values a matrix product state may drop at each split\n"
+		"         --noise <file>  noise channels following the gates of files (see README)\n"
+		"         --noise-mode <m> apply noise to a density matrix or by drawing trajectories (density or trajectories)\n"
+		"         --compile <out> write the optimized gates of file to compiled circuit out (run like a file) and exit\n"
+		"         --sweep <csv>   run file at each point of a table of values of its parameters (see README)\n"
+		"         --observables <list> Pauli products whose expectation a sweep prints at each point (Z of each qubit by default)\n"
+		"         --shots <n>     run file once and print histogram of n measurements of its final state\n"
+		"         --seed <n>      seed of measurements, to reproduce a run\n"
+		"         --rng <name>    random number generator of measurements (xoshiro256 or pcg32)\n"
+		"         --ranks <n>     processes the state vector of a file is split over (a power of 2)\n"
+		"         --rank <r>      rank of this process, when each rank is started separately (else started here)\n"
+		"         --hosts <list>  comma separated hosts of the ranks (127.0.0.1 by default)\n"
+		"         --port <p>      rank r listens on port p + r (7600 by default)\n"
+		"       myqasm [options] --benchmark <size>";
+	string target = "";
+	size_t shots = 0;
+	unsigned int ranks = 1;
+	int rank = -1;
+	vector<string> hosts;
+	unsigned short port = 7600;
+	string output = "";
+	string table = "";
+	string observables = "";
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg.compare("--memory") == 0 && i + 1 < argc) {
+			try {
+				Registry::set_memory_budget((size_t)stoull(argv[++i]) << 20);
+			}
+			catch (exception) {
+				cout << "Memory budget must be an integral number of MiB" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--threads") == 0 && i + 1 < argc) {
+			try {
+				ThreadPool::set_threads(stoul(argv[++i]));
+			}
+			catch (exception) {
+				cout << "Number of threads must be integral" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--kernels") == 0 && i + 1 < argc) {
+			if (!kernels::select(argv[++i])) {
+				cout << "Kernels " << argv[i] << " not supported" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--precision") == 0 && i + 1 < argc) {
+			string precision = argv[++i];
+			if (precision.compare("float") == 0) Registry::single_precision = true;
+			else if (precision.compare("double") == 0) Registry::single_precision = false;
+			else {
+				cout << "Precision must be float or double" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--layout") == 0 && i + 1 < argc) {
+			string layout = argv[++i];
+			if (layout.compare("split") == 0) Registry::layout = Layout::split;
+			else if (layout.compare("interleaved") == 0) Registry::layout = Layout::interleaved;
+			else {
+				cout << "Layout must be interleaved or split" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--fusion") == 0 && i + 1 < argc) {
+			try {
+				Routine::fusion_width = stoul(argv[++i]);
+			}
+			catch (exception) {
+				cout << "Fusion width must be integral" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--cache") == 0 && i + 1 < argc) {
+			try {
+				Registry::cache_size = (size_t)stoull(argv[++i]) << 10;
+			}
+			catch (exception) {
+				cout << "Cache size must be an integral number of KiB" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--stream") == 0 && i + 1 < argc) {
+			try {
+				stream_batch = (size_t)stoull(argv[++i]);
+			}
+			catch (exception) {
+				cout << "Batch size must be integral" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--sweep") == 0 && i + 1 < argc) table = argv[++i];
+		else if (arg.compare("--observables") == 0 && i + 1 < argc) observables = argv[++i];
+		else if (arg.compare("--stabilizer") == 0 && i + 1 < argc) {
+			string stabilizer = argv[++i];
+			if (stabilizer.compare("on") == 0) Registry::stabilizer = true;
+			else if (stabilizer.compare("off") == 0) Registry::stabilizer = false;
+			else {
+				cout << "Stabilizer must be on or off" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--sparse") == 0 && i + 1 < argc) {
+			try {
+				Registry::sparse_fill = stod(argv[++i]);
+			}
+			catch (exception) {
+				cout << "Sparse fill must be a number" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--mps") == 0 && i + 1 < argc) {
+			try {
+				Registry::mps_bond = stoul(argv[++i]);
+			}
+			catch (exception) {
+				cout << "Bond dimension must be integral" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--truncation") == 0 && i + 1 < argc) {
+			try {
+				Registry::mps_truncation = stod(argv[++i]);
+			}
+			catch (exception) {
+				cout << "Truncation must be a number" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--noise") == 0 && i + 1 < argc) {
+			try {
+				noise.load(argv[++i]);
+			}
+			catch (runtime_error e) {
+				cout << e.what() << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--noise-mode") == 0 && i + 1 < argc) {
+			string mode = argv[++i];
+			if (mode.compare("density") == 0) trajectories = false;
+			else if (mode.compare("trajectories") == 0) trajectories = true;
+			else {
+				cout << "Noise mode must be density or trajectories" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--compile") == 0 && i + 1 < argc) output = argv[++i];
+		else if (arg.compare("--shots") == 0 && i + 1 < argc) {
+			try {
+				shots = stoull(argv[++i]);
+			}
+			catch (exception) {
+				cout << "Number of shots must be integral" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--seed") == 0 && i + 1 < argc) {
+			try {
+				rng::seed(stoull(argv[++i]));
+			}
+			catch (exception) {
+				cout << "Seed must be integral" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--rng") == 0 && i + 1 < argc) {
+			if (!rng::select(argv[++i])) {
+				cout << "Random number generator " << argv[i] << " not supported" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--ranks") == 0 && i + 1 < argc) {
+			try {
+				ranks = stoul(argv[++i]);
+			}
+			catch (exception) {
+				ranks = 0;
+			}
+			if (ranks == 0 || (ranks & (ranks - 1)) != 0) {
+				cout << "Number of ranks must be a power of 2" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--rank") == 0 && i + 1 < argc) {
+			try {
+				rank = stoi(argv[++i]);
+			}
+			catch (exception) {
+				cout << "Rank must be integral" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--hosts") == 0 && i + 1 < argc) {
+			string list = argv[++i];
+			for (size_t begin = 0, end; begin <= list.size(); begin = end + 1) {
+				end = list.find(',', begin);
+				if (end == string::npos) end = list.size();
+				if (end > begin) hosts.push_back(list.substr(begin, end - begin));
+			}
+		}
+		else if (arg.compare("--port") == 0 && i + 1 < argc) {
+			try {
+				port = (unsigned short)stoul(argv[++i]);
+			}
+			catch (exception) {
+				cout << "Port must be integral" << endl;
+				return 0;
+			}
+		}
+		else if (arg.compare("--benchmark") == 0 && i + 1 < argc) {
+			try {
+				unsigned int size = stoi(argv[++i]);
+				benchmark_kernels(size);
+				benchmark_precision(size);
+				benchmark_layouts(size);
+			}
+			catch (Registry::memory_exception e) {
+				cout << e.what() << endl;
+			}
+			catch (exception) {
+				cout << usage << endl;
+			}
+			return 0;
+		}
+		else if (target.empty() && arg.compare(0, 2, "--") != 0) target = arg;
+		else {
+			cout << usage << endl;
+			return 0;
+		}
+	}
+
+	if (target.empty()) {
+		cout << usage << endl;
+		return 0;
+	}
+
+	//noisy files run on density matrices, unless trajectories of state vectors are drawn instead
+	Registry::density = !noise.empty() && !trajectories;
+
+	if (!output.empty()) {
+		try {
+			Routine* routine = compile_file(target);
+			if (routine != nullptr) {
+				circuit::save(*routine, output);
+				cout << "compiled " << routine->length() << " instructions to " << output << endl;
+			}
+		}
+		catch (runtime_error e) {
+			cout << e.what() << endl;
+		}
 		return 0;
 	}
 
+	if (!table.empty()) {
+		if (ranks > 1) {
+			cout << "Sweeps run on a single rank" << endl;
+			return 0;
+		}
+		try {
+			sweep_file(target, table, observables, shots);
+		}
+		catch (Registry::memory_exception e) {
+			cout << e.what() << endl;
+		}
+		catch (runtime_error e) {
+			cout << e.what() << endl;
+		}
+		return 0;
+	}
+
+	//every rank runs the file with the seed of rank 0, and only rank 0 prints
+	if (ranks > 1) {
+		if (rank >= (int)ranks) {
+			cout << "Rank must be below number of ranks" << endl;
+			return 0;
+		}
+		try {
+			if (rank < 0) rank = cluster::spawn(ranks);
+			cluster::connect(rank, ranks, hosts, port);
+		}
+		catch (runtime_error e) {
+			cout << e.what() << endl;
+			cluster::disconnect();
+			return 0;
+		}
+		uint64_t seed = rng::seed();
+		cluster::broadcast(&seed, sizeof(seed));
+		rng::seed(seed);
+		if (rank != 0) cout.rdbuf(nullptr);
+	}
+
 	try {
-		int size = stoi(argv[1]);
-		if (size < 2 || size > 8) {
-			cout << "Size of registry must be between 2 and 8 qubits" << endl;
+		int size = stoi(target);
+		if (size < 2) {
+			cout << "Size of registry must be at least 2 qubits" << endl;
+			return 0;
+		}
+		if (ranks > 1) {
+			cout << "Ranks run files only" << endl;
+			cluster::disconnect();
 			return 0;
 		}
-		registry = new QRegistry(size);
+		registry = Registry::create(size);
 		cout << "Ready..." << endl;
 	} catch (invalid_argument) {
-		cout << interpret_file(argv[1]) << endl;
+		try {
+			if (shots > 0) sample_file(target, shots);
+			else cout << interpret_file(target) << endl;
+		}
+		catch (Registry::memory_exception e) {
+			cout << e.what() << endl;
+		}
+		catch (runtime_error e) {
+			cout << e.what() << endl;
+		}
+		delete registry;
+		cluster::disconnect();
 		return 0;
 	} catch (out_of_range) {
-		cout << "Size of registry must be between 2 and 8 qubits" << endl;
+		cout << "Size of registry out of range" << endl;
+		return 0;
+	} catch (Registry::memory_exception e) {
+		cout << e.what() << endl;
 		return 0;
 	}
 	
 	string line = "";
 
-	while (true) {
-		getline(cin, line);
-		interpret(line, cin);
-		line = "";
-	}
+	while (getline(cin, line)) interpret(line, cin);
 
 	delete registry;
 }
 
-int interpret_file(const string& filename) {
-	ifstream in(filename);
-	if (in.fail()) throw runtime_error("error: failed to load file " + filename);
-
-	string line = "";
-	getline(in, line);
-	vector<string>* words = get_words(line);
-	while ((*words).size() == 0) {
-		delete words;
-		line = "";
-		getline(in, line);
-		words = get_words(line);
-	}
-
-	if ((*words)[0].compare("qubits") != 0) throw runtime_error("error: file must begin with instruction qubits <size>");
-	if (words->size() != 2) throw runtime_error("error: file must begin with instruction qubits <size>");
-	
+//parses line into s, aborting on a syntax error as on any error of an instruction
+static void parse_line(const string& line, qasm::statement& s) {
 	try {
-		int size = stoi((*words)[1]);
-		if (size < 2 || size > 8) {
-			cout << "error: size of registry must be between 2 and 8 qubits" << endl;
-			return 0;
-		}
-		registry = new QRegistry(size);
-		cout << "Ready..." << endl;
+		qasm::parse(line, s);
 	}
-	catch (invalid_argument) {
+	catch (runtime_error e) {
+		cout << e.what() << endl;
+		abort();
+	}
+}
+
+//reads the first statement of file in, which must be qubits <size>. returns size, or 0 (having printed why) if it is
+//invalid. throws runtime_error if the file does not begin with the statement.
+static unsigned int read_size(istream& in) {
+	string line;
+	qasm::statement s;
+	do {
+		if (!getline(in, line)) throw runtime_error("error: file must begin with instruction qubits <size>");
+		qasm::parse(line, s);
+	} while (s.kind == qasm::statement_kind::empty);
+
+	if (s.kind != qasm::statement_kind::qubits || s.args.size() != 1)
+		throw runtime_error("error: file must begin with instruction qubits <size>");
+
+	unsigned int size = 0;
+	if (!qasm::parse_index(s.args[0], size)) {
 		cout << "error: size must be of integral type" << endl;
 		return 0;
 	}
-	catch (out_of_range) {
-		cout << "error: size of registry must be between 2 and 8 qubits" << endl;
+	if (size < 2) {
+		cout << "error: size of registry must be at least 2 qubits" << endl;
 		return 0;
 	}
-	
-	//delete words;
+	return size;
+}
 
-	while (words->size() == 0 || (*words)[0].compare("measure") != 0) {
-		delete words;
-		line = "";
-		getline(in, line);
-		words = get_words(line);
-		if (words->size() == 0) continue;
-		interpret(line, in);
+Routine* compile_file(const string& filename) {
+	auto found = compiled.find(filename);
+	if (found != compiled.end()) return found->second.get();
+
+	//compiled circuits hold the routine as it is run, channels of their noise included
+	if (circuit::compiled(filename)) {
+		Routine* result = circuit::load(filename);
+		compiled.emplace(filename, unique_ptr<Routine>(result));
+		if (result->noisy()) Registry::density = !trajectories;
+		return result;
 	}
 
-	delete words;
-	return registry->measure_all();
+	ifstream in(filename);
+	if (in.fail()) throw runtime_error("error: failed to load file " + filename);
+
+	unsigned int size = read_size(in);
+	if (size == 0) return nullptr;
+
+	//gate instructions up to the measurement are appended to routine instead of applied
+	unique_ptr<Routine> routine(new Routine(size));
+	program = routine.get();
+
+	//the statement and line are reused by every line of the file
+	string line;
+	qasm::statement s;
+	while (getline(in, line)) {
+		parse_line(line, s);
+		if (s.kind == qasm::statement_kind::measure && s.args.size() == 0) break;
+		interpret(s, in);
+	}
+
+	program = nullptr;
+	size_t gates = routine->length();
+	size_t cancelled = 0;
+	size_t removed = routine->optimize(&cancelled);
+	if (cancelled > 0) cout << "optimizer removed " << cancelled << " of " << gates << " gates" << endl;
+	if (removed > cancelled) cout << "fusion merged " << gates - cancelled << " gates into " << routine->length() << " instructions" << endl;
+
+	Routine* result = routine.get();
+	compiled.emplace(filename, move(routine));
+	return result;
 }
 
-void interpret(string line, istream& in) {
-	const vector<string>* words = get_words(line);
+//truncation error of a matrix product state, 0 for the registries holding the exact state
+static double truncation_error(const Registry& registry) {
+	const MpsRegistry* mps = dynamic_cast<const MpsRegistry*>(&registry);
+	return (mps != nullptr) ? mps->truncation_error() : 0;
+}
+
+//reads a text file on a thread of its own into batches of about stream_batch instructions, each cancelled and fused
+//as a routine of its own while the batch before is applied. no more than three batches (one being read, one read
+//and one being applied) are held at once, whatever the length of the file.
+class batch_reader {
+private:
+	ifstream in_;
+	unsigned int size_;
+
+	//gates defined before the file, the others being defined by it
+	set<string> defined_;
+
+	thread thread_;
+	mutex mutex_;
+	condition_variable changed_;
 
+	//batch read and not yet taken
+	unique_ptr<Routine> ready_;
 
-	if ((*words)[0].compare("gate") == 0) {
+	//all batches read, or reading failed with error_
+	bool done_;
+	exception_ptr error_;
+
+	//set by the destructor to stop reading
+	bool stop_;
+
+	//reads batches up to the measurement of the file, on thread_
+	void read() {
 		try {
-			define_gate(*words, in);
-		}
-		catch (runtime_error e) {
-			cout << e.what() << endl;
-			abort();
+			string line;
+			qasm::statement s;
+			bool end = false;
+			while (!end) {
+				unique_ptr<Routine> batch(new Routine(size_));
+				program = batch.get();
+				while (batch->length() < stream_batch) {
+					if (!getline(in_, line)) {
+						end = true;
+						break;
+					}
+					parse_line(line, s);
+					if (s.kind == qasm::statement_kind::measure && s.args.size() == 0) {
+						end = true;
+						break;
+					}
+					interpret(s, in_);
+				}
+				program = nullptr;
+
+				batch->optimize();
+
+				unique_lock<mutex> lock(mutex_);
+				changed_.wait(lock, [this] { return ready_ == nullptr || stop_; });
+				if (stop_) return;
+				ready_ = move(batch);
+				changed_.notify_all();
+			}
 		}
-		catch (exception e) {
-			cout << e.what() << " [unexpected]" << endl;
-			abort();
+		catch (exception) {
+			program = nullptr;
+			lock_guard<mutex> lock(mutex_);
+			error_ = current_exception();
 		}
-		return;
+		lock_guard<mutex> lock(mutex_);
+		done_ = true;
+		changed_.notify_all();
 	}
 
-	if ((*words)[0].compare("measure") == 0) {
-		cout << registry->measure_all() << endl;
-		return;
+public:
+	//opens file and reads its size. throws runtime_error if it cannot be opened or does not begin with its size.
+	batch_reader(const string& filename) : size_(0), done_(false), stop_(false) {
+		in_.open(filename);
+		if (in_.fail()) throw runtime_error("error: failed to load file " + filename);
+		size_ = read_size(in_);
+		for (auto& g : gates) defined_.insert(g.first);
 	}
 
-	if ((*words)[0].compare("include") == 0) {
-		if (words->size() != 2) throw runtime_error("syntax error");
-		try {
-			include_header((*words)[1]);
+	batch_reader(const batch_reader&) = delete;
+
+	batch_reader& operator=(const batch_reader&) = delete;
+
+	//stops reading, and forgets the gates the file defined so that it can be read again
+	~batch_reader() {
+		{
+			lock_guard<mutex> lock(mutex_);
+			stop_ = true;
+			changed_.notify_all();
 		}
-		catch (runtime_error e) {
-			cout << e.what() << endl;
-			abort();
+		if (thread_.joinable()) thread_.join();
+		for (auto g = gates.begin(); g != gates.end();) {
+			if (defined_.count(g->first) != 0) g++;
+			else {
+				delete g->second;
+				g = gates.erase(g);
+			}
 		}
-		catch (exception e) {
-			cout << e.what() << " [unexpected]" << endl;
-			abort();
+	}
+
+	//size of registry, 0 if the size given by the file is invalid
+	unsigned int size() const { return size_; }
+
+	//starts reading batches
+	void start() { thread_ = thread(&batch_reader::read, this); }
+
+	//next batch, nullptr after the last. rethrows the exception reading failed with, if any.
+	unique_ptr<Routine> next() {
+		unique_lock<mutex> lock(mutex_);
+		changed_.wait(lock, [this] { return ready_ != nullptr || done_; });
+		if (ready_ != nullptr) {
+			unique_ptr<Routine> batch = move(ready_);
+			changed_.notify_all();
+			return batch;
 		}
-		return;
+		if (error_) rethrow_exception(error_);
+		return nullptr;
 	}
-	
+};
+
+//runs file on registry, created on the first run (on a stabilizer tableau if the file allows it): compiled whole,
+//or if stream_batch is set and the file is text, applied batch by batch while the next batch is read. returns false
+//if the size the file gives is invalid. sets measuring if the file measures qubits along the way, and clears unitary
+//unless all its instructions are unitary.
+static bool run_file(const string& filename, bool& measuring, bool& unitary) {
+	if (stream_batch == 0 || circuit::compiled(filename)) {
+		Routine* routine = compile_file(filename);
+		if (routine == nullptr) return false;
+		if (registry == nullptr) {
+			registry = Registry::create(routine->size(), routine->clifford());
+			cout << "Ready..." << endl;
+		}
+		(*routine)(*registry);
+		measuring = routine->measuring();
+		unitary = routine->unitary();
+		return true;
+	}
+
+	//whether a streamed file is made of Clifford gates is only known once it is read, so it runs on state vectors
+	batch_reader reader(filename);
+	if (reader.size() == 0) return false;
+	if (registry == nullptr) {
+		registry = Registry::create(reader.size());
+		cout << "Ready..." << endl;
+	}
+	reader.start();
+	measuring = false;
+	unitary = true;
+	for (unique_ptr<Routine> batch = reader.next(); batch != nullptr; batch = reader.next()) {
+		(*batch)(*registry);
+		measuring = measuring || batch->measuring();
+		unitary = unitary && batch->unitary();
+	}
+	return true;
+}
+
+void sample_file(const string& filename, size_t shots) {
+	MeasureInstruction::verbose = false;
+	bool measuring = false;
+	bool unitary = true;
+	if (!run_file(filename, measuring, unitary)) return;
+
+	//values of registries of more than 64 qubits are counted as bit strings
+	bool bits = registry->size() > 64;
+
+	//a file measuring qubits along the way must be run again for every shot, as must one drawing noise on
+	//a pure state (each run a trajectory)
+	map<uint64_t, size_t> counts;
+	map<string, size_t> bit_counts;
+	double error = truncation_error(*registry);
+	if (!measuring && (unitary || registry->mixed())) {
+		if (bits) bit_counts = registry->sample_bits(shots);
+		else counts = registry->sample(shots);
+	}
+	else {
+		for (size_t i = 0; i < shots; i++) {
+			if (i > 0) {
+				registry->reset();
+				echo_gates = false;
+				run_file(filename, measuring, unitary);
+				error = max(error, truncation_error(*registry));
+			}
+			if (bits) bit_counts[registry->measure_bits()]++;
+			else counts[registry->measure_all()]++;
+		}
+	}
+	if (dynamic_cast<MpsRegistry*>(registry) != nullptr) cout << "truncation error: " << error << endl;
+
+	for (auto& count : counts) cout << count.first << ": " << count.second << endl;
+	for (auto& count : bit_counts) cout << count.first << ": " << count.second << endl;
+}
+
+string interpret_file(const string& filename) {
+	bool measuring = false;
+	bool unitary = true;
+	if (!run_file(filename, measuring, unitary)) return "0";
+
+	if (dynamic_cast<MpsRegistry*>(registry) != nullptr) cout << "truncation error: " << truncation_error(*registry) << endl;
+	if (registry->size() > 64) return registry->measure_bits();
+	return to_string(registry->measure_all());
+}
+
+void interpret(const string& line, istream& in) {
+	//statement reused by every line read
+	static qasm::statement s;
+	parse_line(line, s);
+	interpret(s, in);
+}
+
+void interpret(const qasm::statement& s, istream& in) {
 	try {
-		apply_gate_instruction(*words);
-	} catch (runtime_error e) {
+		if (s.kind == qasm::statement_kind::empty) return;
+
+		if (s.kind == qasm::statement_kind::define) {
+			define_gate(s, in);
+			return;
+		}
+
+		if (s.kind == qasm::statement_kind::measure) {
+			if (s.args.size() == 0) {
+				if (registry->size() > 64) cout << registry->measure_bits() << endl;
+				else cout << registry->measure_all() << endl;
+				return;
+			}
+
+			//measure q measures a single qubit, and is an instruction of the routine being compiled if any
+			unsigned int q = 0;
+			if (s.args.size() != 1 || !qasm::parse_index(s.args[0], q)) throw runtime_error("syntax error");
+			if (q >= (program != nullptr ? program->size() : registry->size())) throw runtime_error("registry not large enough");
+			if (program != nullptr) program->append(new MeasureInstruction(q));
+			else cout << registry->measure(q) << endl;
+			return;
+		}
+
+		if (s.kind == qasm::statement_kind::include) {
+			if (s.args.size() != 1) throw runtime_error("syntax error");
+			include_header(string(s.args[0]));
+			return;
+		}
+
+		if (s.kind != qasm::statement_kind::call) throw runtime_error("syntax error");
+		apply_gate_instruction(s);
+	}
+	catch (runtime_error e) {
 		cout << e.what() << endl;
 		abort();
 	}
@@ -168,248 +754,214 @@ void interpret(string line, istream& in) {
 		cout << e.what() << " [unexpected]" << endl;
 		abort();
 	}
+}
 
-	delete words;
+//throws runtime_error unless gate g (named name) takes argc arguments
+static void check_argc(const string& name, const qasm::gate* g, size_t argc) {
+	if (g->variadic() ? argc >= g->argc() : argc == g->argc()) return;
+	throw runtime_error("error: number of arguments for gate " + name + " is " + (g->variadic() ? "at least " : "")
+		+ to_string(g->argc()));
 }
 
-vector<string>* get_words(string line) {
-	int wcount = 0;
-	bool whitespace = true; //last character read was whitespace
-	for (char c : line) {
-		if (whitespace) {
-			if (isspace(c)) continue;
-			whitespace = false;
-			wcount++;
-		}
-		else if (isspace(c)) whitespace = true;
+//gate of given name, throws runtime_error if there is none or it does not take paramc parameters
+static qasm::gate* find_gate(const string& name, size_t paramc) {
+	auto found = gates.find(name);
+	if (found == gates.end()) throw runtime_error("error: gate " + name + " not found");
+	if (found->second->paramc() != paramc)
+		throw runtime_error("error: number of parameters for gate " + name + " is " + to_string(found->second->paramc()));
+	return found->second;
+}
+
+void apply_gate_instruction(const qasm::statement& s) {
+	//kept from instruction to instruction, so that the gates of a file are read without allocating
+	static string name;
+	static vector<double> params;
+	static vector<unsigned int> args;
+	static vector<qasm::param_ref> refs;
+	static vector<qasm::op> ops;
+	static vector<unsigned int> controls;
+
+	name.assign(s.name.data(), s.name.size());
+	qasm::gate* g = find_gate(name, s.params.size());
+
+	params.clear();
+	for (const qasm::param_token& p : s.params) {
+		if (!p.name.empty()) throw runtime_error("error: undefined identifier " + string(p.name));
+		params.push_back(p.value);
 	}
 
-	//now value of wcount is number of words (substrings of non-space characters seperated by whitespace) in line
+	args.clear();
+	for (string_view a : s.args) {
+		unsigned int q = 0;
+		if (!qasm::parse_index(a, q)) throw runtime_error("syntax error");
+		args.push_back(q);
+	}
 
-	vector<string>* words = new vector<string>; //vector of words in line
-	whitespace = true;
-	
-	for (char c : line) {
-		if (whitespace) {
-			if (isspace(c)) continue;
-			whitespace = false;
-			words->push_back(string(""));
-			*(words->end() - 1) += c;
-		}
-		else if (isspace(c)) whitespace = true;
-		else *(words->end() - 1) += c;
+	check_argc(name, g, args.size());
+
+	if (program != nullptr) {
+		refs.clear();
+		for (double p : params) refs.push_back({ -1, p });
+
+		ops.clear();
+		controls.clear();
+		g->compile(refs, args, ops, controls);
+		for (const qasm::op& o : ops) program->append(op_instruction(o, controls.data()));
+		noise.append(*program, name, args);
+		return;
 	}
 
-	return words;
+	g->apply(params, args);
 }
 
-void apply_gate_instruction(const vector<string>& words) {
-	//parse the name of the gate and its parameters.
-	//for gate U and parameters (p1, p2, ..., pi) correct syntax is U(p1,p2,...,pi) - no whitspaces allowed.
-	//a gate with no parameters must omit parantheses.
-	string gate_name = "";
-	vector<double> params;
-	string param = ""; //current parameter to read
-	bool open_paranth = false; //found open paranthesis - start parsing gate parameters
-	bool closed_paranth = false; //found closed paranthesis - finish parsing gate parameters
-	for (char c : words[0]) {
-		if (closed_paranth) throw runtime_error("syntax error");
-		if (!open_paranth) {
-			if (c == ')') throw runtime_error("syntax error");
-			if (c == '(') {
-				open_paranth = true;
-				continue;
-			}
-			gate_name += c;
-		}
-		else {
-			if (c == '(') throw runtime_error("syntax error");
-			if (c == ')') {
-				if (param.compare("") == 0) throw runtime_error("syntax error");
-				else {
-					closed_paranth = true;
-					c = ',';
-				}
-			}
-			if (c != ',') param += c;
-			else {
-				try {
-					params.push_back(stod(param));
-					param = "";
-					continue;
-				}
-				catch (invalid_argument) {
-					throw runtime_error("syntax error");
-				}
-			}
-		}
-	}
+//position of name among the parameters of a gate definition, -1 if it is not one of them
+static int param_slot(const vector<qasm::param_token>& params, string_view name) {
+	for (size_t i = 0; i < params.size(); i++) if (params[i].name == name) return (int)i;
+	return -1;
+}
 
-	//check if gate exists and if number of parameters is correct
-	if (gates.count(gate_name) == 0) throw runtime_error("error: gate " + gate_name + " not found");
-	qasm::gate* g = gates.at(gate_name);
-	if (g->paramc() != params.size())
-		throw runtime_error("error: number of parameters for gate " + gate_name + " is " + to_string(g->paramc()));
+//position of name among the arguments of a gate definition, -1 if it is not one of them
+static int arg_slot(const vector<string_view>& args, string_view name) {
+	for (size_t i = 0; i < args.size(); i++) if (args[i] == name) return (int)i;
+	return -1;
+}
 
-	//now parse arguments into vector
-	vector<unsigned int> args;
+//appends call s to gate. its parameters are constants or names among params, the parameters of gate in order, and
+//arg(word) is the slot of the argument of gate each of its arguments is (-1 if none). throws runtime_error if the
+//call is not valid.
+template<typename F>
+static void add_call(const qasm::statement& s, const vector<qasm::param_token>& params, const F& arg, qasm::custom_gate& gate) {
+	//kept from call to call, as in apply_gate_instruction
+	static string name;
+	static vector<qasm::param_ref> refs;
+	static vector<unsigned int> args;
 
-	for (int i = 1; i < words.size(); i++) {
-		try {
-			args.push_back(abs(stoi(words[i])));
-		}
-		catch (invalid_argument) {
-			throw runtime_error("syntax error");
+	name.assign(s.name.data(), s.name.size());
+	qasm::gate* g = find_gate(name, s.params.size());
+
+	refs.clear();
+	for (const qasm::param_token& p : s.params) {
+		if (p.name.empty()) {
+			refs.push_back({ -1, p.value });
+			continue;
 		}
+		int slot = param_slot(params, p.name);
+		if (slot < 0) throw runtime_error("error: undefined identifier " + string(p.name));
+		refs.push_back({ slot, 0 });
 	}
 
-	if (g->argc() != args.size())
-		throw runtime_error("error: number of arguments for gate " + gate_name + " is " + to_string(g->argc()));
+	args.clear();
+	for (string_view a : s.args) {
+		int slot = arg(a);
+		if (slot < 0) throw runtime_error("error: undefined identifier " + string(a));
+		args.push_back((unsigned int)slot);
+	}
+	check_argc(name, g, args.size());
 
-	g->apply(params, args);
+	gate.add_instruction(g, refs, args);
 }
 
-void define_gate(const vector<string>& words, istream& in) {
-	unordered_map<string, unsigned int> param_ids; //parameter identifiers
-	unordered_map<string, unsigned int> arg_ids; //argument identifiers
-
-	if (words.size() < 4) throw runtime_error("syntax error");
-
-	//parse the name of the gate and its parameters.
-	//for gate U and parameters (p1, p2, ..., pi) correct syntax is U(p1,p2,...,pi) - no whitspaces allowed.
-	//a gate with no parameters must omit parantheses.
-	string gate_name = "";
-	vector<double> params;
-	string param = ""; //current parameter to read
-	unsigned int paramc = 0; //index of current parameter, at end of loop number of parameters
-	bool open_paranth = false; //found open paranthesis - start parsing gate parameters
-	bool closed_paranth = false; //found closed paranthesis - finish parsing gate parameters
-	for (char c : words[1]) {
-		if (closed_paranth) throw runtime_error("syntax error");
-		if (!open_paranth) {
-			if (c == ')') throw runtime_error("syntax error");
-			if (c == '(') {
-				open_paranth = true;
-				continue;
-			}
-			gate_name += c;
-		}
-		else {
-			if (c == '(') throw runtime_error("syntax error");
-			if (c == ')') {
-				if (param.compare("") == 0) throw runtime_error("syntax error");
-				else {
-					closed_paranth = true;
-					c = ',';
-				}
-			}
-			if (c != ',') param += c;
-			else {
-				try {
-					if (param_ids.count(param) != 0) throw runtime_error("error: parameter " + param + " already defined");
-					param_ids.emplace(param, paramc);
-					param = "";
-					paramc++;
-					continue;
-				}
-				catch (invalid_argument) {
-					throw runtime_error("syntax error");
-				}
+//unitary of ops on qubits 0 to argc - 1 (the further controls of their mcx ops in controls), with parameters
+//params: column j is the state ops turn |j> into
+static vector<vector<complex<double>>> unitary(const vector<qasm::op>& ops, const vector<unsigned int>& controls,
+	const vector<double>& params, unsigned int argc) {
+
+	size_t length = (size_t)1 << argc;
+	vector<vector<complex<double>>> u(length, vector<complex<double>>(length, 0));
+	for (size_t j = 0; j < length; j++) {
+		vector<complex<double>>& state = u[j];
+		state[j] = 1;
+		for (const qasm::op& o : ops) {
+			complex<double> m[4];
+			op_matrix(o.code, o.param.slot >= 0 ? params[o.param.slot] : o.param.value, m);
+
+			//amplitude pairs differing in the target, with every control set
+			size_t target = (size_t)1 << (is_controlled(o.code) ? o.args[1] : o.args[0]);
+			size_t mask = 0;
+			if (is_controlled(o.code)) mask |= (size_t)1 << o.args[0];
+			for (unsigned int j = 0; j < o.controlc; j++) mask |= (size_t)1 << controls[o.first_control + j];
+			for (size_t i = 0; i < length; i++) {
+				if ((i & target) != 0 || (i & mask) != mask) continue;
+				complex<double> a0 = state[i], a1 = state[i | target];
+				state[i] = m[0] * a0 + m[1] * a1;
+				state[i | target] = m[2] * a0 + m[3] * a1;
 			}
 		}
 	}
+	return u;
+}
+
+//true if gate applies the same unitary as built-in, up to a global phase, at a few values of their parameters
+static bool same_unitary(const qasm::custom_gate& gate, const qasm::gate& builtin) {
+	vector<qasm::param_ref> refs;
+	vector<unsigned int> args;
+	for (unsigned int i = 0; i < gate.paramc(); i++) refs.push_back({ (int)i, 0 });
+	for (unsigned int i = 0; i < gate.argc(); i++) args.push_back(i);
+	vector<qasm::op> ops;
+	vector<unsigned int> controls;
+	builtin.compile(refs, args, ops, controls);
 
-	if (gates.count(gate_name) != 0) throw runtime_error("error: gate " + gate_name + " already exists");
+	for (double th : { 0.3, 1.9 }) {
+		vector<double> params(gate.paramc(), th);
+		vector<vector<complex<double>>> a = unitary(gate.ops(), gate.controls(), params, gate.argc());
+		vector<vector<complex<double>>> b = unitary(ops, controls, params, gate.argc());
 
-	unsigned int argc = 0;
-	for (int i = 2; i < words.size() - 1; i++) {
-		if (words[i].find('{') != string::npos) throw runtime_error("syntax error");
-		if (arg_ids.count(words[i]) != 0) throw runtime_error("error: argument " + words[i] + " already defined");
-		arg_ids.emplace(words[i], argc);
-		argc++;
+		//the phase is that of the trace of b^dagger a, which has magnitude 2^argc when they match. entries are
+		//compared loosely, as decompositions made of T gates carry the error of consts::pi
+		complex<double> trace = 0;
+		for (size_t j = 0; j < a.size(); j++) for (size_t i = 0; i < a.size(); i++) trace += conj(b[j][i]) * a[j][i];
+		if (abs(trace) == 0) return false;
+		complex<double> phase = trace / abs(trace);
+		for (size_t j = 0; j < a.size(); j++) {
+			for (size_t i = 0; i < a.size(); i++) if (abs(a[j][i] - phase * b[j][i]) > 1e-6) return false;
+		}
 	}
+	return true;
+}
 
-	if (argc == 0) throw runtime_error("error: gate must take at least 1 argument");
-	if (words[words.size() - 1].compare("{") != 0) throw runtime_error("syntax error");
+void define_gate(const qasm::statement& s, istream& in) {
+	string gate_name(s.name);
 
-	qasm::custom_gate* gate = new qasm::custom_gate(paramc, argc);
-	
-	string line = "";
-	getline(in, line);
-	vector<string>* words_in = get_words(line);
-	while (line.find("}") == string::npos) {
-		if (words_in->size() == 0) continue;
-		
-		//parse the name of the gate and its parameters.
-		//for gate U and parameters (p1, p2, ..., pi) correct syntax is U(p1,p2,...,pi) - no whitspaces allowed.
-		//a gate with no parameters must omit parantheses.
-		string gate_name_in = "";
-		vector<pair<double*, unsigned int>> params_in;
-		string param = ""; //current parameter to read
-		bool open_paranth = false; //found open paranthesis - start parsing gate parameters
-		bool closed_paranth = false; //found closed paranthesis - finish parsing gate parameters
-		for (char c : (*words_in)[0]) {
-			if (closed_paranth) throw runtime_error("syntax error");
-			if (!open_paranth) {
-				if (c == ')') throw runtime_error("syntax error");
-				if (c == '(') {
-					open_paranth = true;
-					continue;
-				}
-				gate_name_in += c;
-			}
-			else {
-				if (c == '(') throw runtime_error("syntax error");
-				if (c == ')') {
-					if (param.compare("") == 0) throw runtime_error("syntax error");
-					else {
-						closed_paranth = true;
-						c = ',';
-					}
-				}
-				if (c != ',') param += c;
-				else {
-					try {
-						params_in.push_back(pair<double*, unsigned int>(new double(stod(param)), 0));
-						param = "";
-						continue;
-					}
-					catch (invalid_argument) {
-						if (param_ids.count(param) == 0) throw runtime_error("error: undefined identifier " + param);
-						params_in.push_back(pair<double*, unsigned int>(nullptr, param_ids.at(param)));
-					}
-				}
-			}
-		}
+	//the slots of the parameters and arguments of the gate are their positions in its header
+	for (size_t i = 0; i < s.params.size(); i++) {
+		if (param_slot(s.params, s.params[i].name) != (int)i)
+			throw runtime_error("error: parameter " + string(s.params[i].name) + " already defined");
+	}
+	for (size_t i = 0; i < s.args.size(); i++) {
+		if (arg_slot(s.args, s.args[i]) != (int)i) throw runtime_error("error: argument " + string(s.args[i]) + " already defined");
+	}
+	unsigned int paramc = (unsigned int)s.params.size();
+	unsigned int argc = (unsigned int)s.args.size();
 
-		//check if gate exists and if number of parameters is correct
-		if (gates.count(gate_name_in) == 0) throw runtime_error("error: gate " + gate_name_in + " not found");
-		qasm::gate* g = gates.at(gate_name_in);
-		if (g->paramc() != params_in.size())
-			throw runtime_error("error: number of parameters for gate " + gate_name_in + " is " + to_string(g->paramc()));
+	//files written before a gate became built-in may define it: the definition must apply the same unitary as the
+	//built-in (up to a global phase), which is then kept in its place
+	bool builtin = gates.count(gate_name) != 0 && dynamic_cast<qasm::primitive_gate*>(gates.at(gate_name)) != nullptr;
+	if (gates.count(gate_name) != 0 && !builtin) throw runtime_error("error: gate " + gate_name + " already exists");
 
-		//parse arguments
-		vector<unsigned int> args_in;
-		for (int i = 1; i < words_in->size(); i++) {
-			if (arg_ids.count((*words_in)[i]) == 0) throw runtime_error("error: undefined identifier " + (*words_in)[i]);
-			args_in.push_back(arg_ids.at((*words_in)[i]));
-		}
+	if (argc == 0) throw runtime_error("error: gate must take at least 1 argument");
+	if (builtin && (gates.at(gate_name)->paramc() != paramc || gates.at(gate_name)->argc() != argc))
+		throw runtime_error("error: gate " + gate_name + " already exists");
 
-		//add instruction
-		gate->add_instruction(gates.at(gate_name_in), params_in, args_in);
+	unique_ptr<qasm::custom_gate> gate(new qasm::custom_gate(paramc, argc));
 
-		for (auto i : params_in) if (i.first != nullptr) delete i.first;
+	//the body runs to a line of a closing brace, and the header s stays valid while it is read into line
+	string line;
+	qasm::statement body;
+	while (true) {
+		if (!getline(in, line)) throw runtime_error("syntax error");
+		qasm::parse(line, body);
+		if (body.kind == qasm::statement_kind::end) break;
+		if (body.kind == qasm::statement_kind::empty) continue;
+		if (body.kind != qasm::statement_kind::call) throw runtime_error("syntax error");
 
-		line = "";
-		getline(in, line);
-		words_in = get_words(line);
+		add_call(body, s.params, [&s](string_view a) { return arg_slot(s.args, a); }, *gate);
 	}
 
-	if (line.compare("}") != 0) throw runtime_error("syntax error");
-
-	gates.insert(pair<string, qasm::gate*>(gate_name, gate));
+	if (builtin && !same_unitary(*gate, *gates.at(gate_name)))
+		throw runtime_error("error: gate " + gate_name + " already exists, and differs from its definition");
+	if (!builtin) gates.insert(pair<string, qasm::gate*>(gate_name, gate.release()));
 
-	cout << gate_name << gates.count(gate_name) << endl;
+	if (echo_gates) cout << gate_name << gates.count(gate_name) << endl;
 }
 
 void include_header(const string& filename) {
@@ -417,33 +969,141 @@ void include_header(const string& filename) {
 	if (in.fail()) throw runtime_error("error: header file " + filename + " not found");
 
 	string line;
-	vector<string>* words;
-	while (!in.eof()) {
-		line = "";
-		getline(in, line);
-		words = get_words(line);
-
-		if (words->size() == 0) {
-			delete words;
-			continue;
-		}
+	qasm::statement s;
+	while (getline(in, line)) {
+		qasm::parse(line, s);
 
-		if ((*words)[0].compare("include") == 0) {
-			if (words->size() != 2) throw runtime_error("syntax error");
-			include_header((*words)[1]);
-			delete words;
+		if (s.kind == qasm::statement_kind::empty) continue;
+
+		if (s.kind == qasm::statement_kind::include) {
+			if (s.args.size() != 1) throw runtime_error("syntax error");
+			include_header(string(s.args[0]));
 			continue;
 		}
 
-		if ((*words)[0].compare("gate") == 0) {
-			define_gate(*words, in);
-			delete words;
+		if (s.kind == qasm::statement_kind::define) {
+			define_gate(s, in);
 			continue;
 		}
 
+		throw runtime_error("error: header file may only contain gate definitions and include statements");
+	}
+}
+
+//compiles file into a gate whose parameters are the parameters of a sweep (names) and whose arguments are the qubits,
+//so that running it at a point only binds their values. returns nullptr if the size the file gives is invalid.
+//throws runtime_error if the file measures qubits along the way.
+static unique_ptr<qasm::custom_gate> compile_sweep(const string& filename, const vector<qasm::param_token>& names) {
+	ifstream in(filename);
+	if (in.fail()) throw runtime_error("error: failed to load file " + filename);
+	unsigned int size = read_size(in);
+	if (size == 0) return nullptr;
 
+	unique_ptr<qasm::custom_gate> gate(new qasm::custom_gate((unsigned int)names.size(), size));
+	auto qubit = [size](string_view a) {
+		unsigned int q = 0;
+		if (!qasm::parse_index(a, q)) throw runtime_error("syntax error");
+		if (q >= size) throw runtime_error("registry not large enough");
+		return (int)q;
+	};
 
-		delete words;
-		throw runtime_error("error: header file may only contain gate definitions and include statements");
+	string line;
+	qasm::statement s;
+	while (getline(in, line)) {
+		parse_line(line, s);
+		if (s.kind == qasm::statement_kind::measure && s.args.size() == 0) break;
+		if (s.kind == qasm::statement_kind::measure) throw runtime_error("error: a swept file may not measure qubits along the way");
+		if (s.kind == qasm::statement_kind::call) add_call(s, names, qubit, *gate);
+		else interpret(s, in);
 	}
-}
\ No newline at end of file
+	return gate;
+}
+
+void sweep_file(const string& filename, const string& table_file, const string& observables, size_t shots) {
+	if (!noise.empty()) throw runtime_error("error: sweeps run without noise");
+
+	sweep::table table = sweep::load(table_file);
+	vector<qasm::param_token> names;
+	for (const string& name : table.names) names.push_back({ name, 0 });
+
+	unique_ptr<qasm::custom_gate> gate = compile_sweep(filename, names);
+	if (gate == nullptr) return;
+	unsigned int size = gate->argc();
+
+	vector<sweep::observable> measured;
+	if (shots == 0) measured = sweep::parse_observables(observables, size);
+	bool bits = size > 64;
+
+	//fails here rather than on a thread of the pool if the registry exceeds the memory budget
+	delete Registry::create(size);
+	cout << "Ready..." << endl;
+
+	//results of each point, filled in by whichever thread runs it
+	size_t count = table.points.size();
+	vector<vector<double>> values(count);
+	vector<map<uint64_t, size_t>> counts(count);
+	vector<map<string, size_t>> bit_counts(count);
+	mutex failed;
+	exception_ptr error;
+
+	//each task runs its points one after another on a registry of its own, binding the values of each point to the
+	//compiled gate and optimizing the routine it expands to
+	parallel_for(count, [&](size_t begin, size_t end) {
+		try {
+			unique_ptr<Registry> r(Registry::create(size));
+			vector<qasm::param_ref> refs(names.size());
+			vector<unsigned int> args(size);
+			for (unsigned int q = 0; q < size; q++) args[q] = q;
+			vector<qasm::op> ops;
+			vector<unsigned int> controls;
+			for (size_t p = begin; p < end; p++) {
+				for (size_t j = 0; j < refs.size(); j++) refs[j] = { -1, table.points[p][j] };
+				ops.clear();
+				controls.clear();
+				gate->compile(refs, args, ops, controls);
+				Routine routine(size);
+				for (const qasm::op& o : ops) routine.append(op_instruction(o, controls.data()));
+				r->reset();
+				routine(*r);
+
+				//point p draws from a stream of its own (past those of the threads), whichever thread runs it
+				rng::restart(((uint64_t)1 << 32) + p);
+				if (shots == 0) for (const sweep::observable& o : measured) values[p].push_back(sweep::expectation(*r, o));
+				else if (bits) bit_counts[p] = r->sample_bits(shots);
+				else counts[p] = r->sample(shots);
+			}
+		}
+		catch (exception) {
+			lock_guard<mutex> lock(failed);
+			if (!error) error = current_exception();
+		}
+	}, (size_t)1 << min(size, 32u));
+	if (error) rethrow_exception(error);
+
+	//csv of the parameters of each point followed by its expectation values, or by each value measured and its count
+	streamsize precision = cout.precision(12);
+	for (const string& name : table.names) cout << name << ",";
+	if (shots == 0) {
+		for (size_t j = 0; j < measured.size(); j++) cout << (j == 0 ? "" : ",") << measured[j].text;
+	}
+	else cout << "value,count";
+	cout << endl;
+
+	for (size_t p = 0; p < count; p++) {
+		string point;
+		for (double v : table.points[p]) {
+			ostringstream field;
+			field.precision(12);
+			field << v << ",";
+			point += field.str();
+		}
+		if (shots == 0) {
+			cout << point;
+			for (size_t j = 0; j < values[p].size(); j++) cout << (j == 0 ? "" : ",") << values[p][j];
+			cout << endl;
+		}
+		for (auto& c : counts[p]) cout << point << c.first << "," << c.second << endl;
+		for (auto& c : bit_counts[p]) cout << point << c.first << "," << c.second << endl;
+	}
+	cout.precision(precision);
+}
@@ -3,26 +3,73 @@
 #include <vector>
 #include <cmath>
 #include <iostream>
+#include <cstdint>
+#include "parser.h"
 
 namespace qasm {
 	class gate;
+	class primitive_gate;
 	class custom_gate;
+
+	//primitive operations (built-in gates) that all gates compile to
+	enum class opcode : unsigned char { rx, ry, rz, ph, t, tdag, h, cnot, ch, mcx };
+
+	//a parameter of an op: slot of the parameters of the enclosing gate, or a constant value if slot is negative
+	struct param_ref {
+		int slot;
+		double value;
+	};
+
+	//a primitive op, with arguments given as slots of the arguments of the enclosing gate. ops own no memory, so a
+	//compiled gate is a contiguous array of them: the further controls of mcx ops are kept in an array beside it.
+	struct op {
+		opcode code;
+		unsigned int args[2];
+		param_ref param;
+
+		//further control qubits of mcx ops, beyond args[0]: entries first_control to first_control + controlc - 1
+		//of the array of controls the op was compiled with (see gate::compile)
+		unsigned int first_control;
+		unsigned int controlc;
+	};
 }
 
-void interpret(std::string line, std::istream& in);
+class Routine;
+
+//parses line and runs its statement, reading the body of a gate definition from in
+void interpret(const std::string& line, std::istream& in);
+
+void interpret(const qasm::statement& s, std::istream& in);
 
-int interpret_file(const std::string& filename);
+//parses file into a routine of the instructions before its measurement, and optimizes it, or maps it if it is a
+//compiled circuit (written by circuit::save). compiled routines are kept, so compiling the same file again returns
+//the same routine without parsing.
+//returns nullptr if size of registry is invalid.
+Routine* compile_file(const std::string& filename);
 
-//apply instruction represented by given vector of words in line, given instruction is a gate
-void apply_gate_instruction(const std::vector<std::string>& words);
+//compiles file, applies it to a new registry and returns the measurement (in binary for registries of more than
+//64 qubits)
+std::string interpret_file(const std::string& filename);
 
-void define_gate(const std::vector<std::string>& words, std::istream& in);
+//compiles file and applies it to a new registry once, then prints the number of times each value
+//was measured in shots measurements of the final state
+void sample_file(const std::string& filename, size_t shots);
+
+//compiles file once, its gates taking the columns of the csv table (see sweep.h) as parameters, and runs it at each
+//point of the table, on the threads of the pool. prints the expectation values of observables (see
+//sweep::parse_observables) at each point, or if shots is not 0 the number of times each value was measured in shots
+//measurements of its final state.
+void sweep_file(const std::string& filename, const std::string& table, const std::string& observables, size_t shots);
+
+//apply instruction of given statement, given instruction is a gate
+void apply_gate_instruction(const qasm::statement& s);
+
+//defines gate of header s, reading its body from in up to the closing brace
+void define_gate(const qasm::statement& s, std::istream& in);
 
 //a header may only include gate definitions and include statements
 void include_header(const std::string& filename);
 
-std::vector<std::string>* get_words(std::string line);
-
 class qasm::gate {
 public:
 	virtual ~gate() = default;
@@ -31,5 +78,13 @@ public:
 	
 	virtual unsigned int argc() const = 0;
 
+	//true if the gate takes argc() or more arguments
+	virtual bool variadic() const { return false; }
+
 	virtual void apply(const std::vector<double>& params, const std::vector<unsigned int>& args) const = 0;
+
+	//appends the primitive ops the gate consists of to ops, and the further controls of their mcx ops to controls,
+	//with its parameters and arguments given as slots of those of an enclosing gate
+	virtual void compile(const std::vector<param_ref>& params, const std::vector<unsigned int>& args, std::vector<op>& ops,
+		std::vector<unsigned int>& controls) const = 0;
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "noise.h"
+#include "quantum.h"
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+vector<complex<double>> NoiseModel::kraus(const string& channel, double p) {
+	if (!(p >= 0 && p <= 1)) throw runtime_error("error: probability of channel " + channel + " must be in [0, 1]");
+
+	const complex<double> i(0, 1);
+	if (channel.compare("depolarizing") == 0) {
+		//rho -> (1 - p) rho + p I / 2, as the identity or one of X, Y, Z each with probability p / 4
+		double a = sqrt(1 - 3 * p / 4), b = sqrt(p / 4);
+		return { a, 0, 0, a, 0, b, b, 0, 0, -i * b, i * b, 0, b, 0, 0, -b };
+	}
+	if (channel.compare("amplitude_damping") == 0) return { 1, 0, 0, sqrt(1 - p), 0, sqrt(p), 0, 0 };
+	if (channel.compare("dephasing") == 0) {
+		//the identity or Z, with probability p / 2
+		double a = sqrt(1 - p / 2), b = sqrt(p / 2);
+		return { a, 0, 0, a, b, 0, 0, -b };
+	}
+	throw runtime_error("error: unknown noise channel " + channel);
+}
+
+void NoiseModel::load(const string& filename) {
+	ifstream in(filename);
+	if (in.fail()) throw runtime_error("error: failed to load file " + filename);
+
+	string line;
+	while (getline(in, line)) {
+		istringstream words(line);
+		string kind, name, channel, extra;
+		double p;
+		if (!(words >> kind) || kind[0] == '#') continue;
+		if (!(words >> name >> channel >> p) || (words >> extra)) throw runtime_error("error: syntax error in noise file: " + line);
+
+		vector<complex<double>> k = kraus(channel, p);
+		if (kind.compare("gate") == 0) gates_[name].push_back(k);
+		else if (kind.compare("qubit") == 0) {
+			try {
+				qubits_[stoul(name)].push_back(k);
+			}
+			catch (exception) {
+				throw runtime_error("error: qubit must be integral: " + line);
+			}
+		}
+		else throw runtime_error("error: noise must follow a gate or a qubit: " + line);
+	}
+}
+
+void NoiseModel::append(Routine& routine, const string& name, const vector<unsigned int>& qubits) const {
+	for (const string& key : { name, string("*") }) {
+		auto found = gates_.find(key);
+		if (found == gates_.end()) continue;
+		for (const vector<complex<double>>& k : found->second) {
+			for (unsigned int q : qubits) routine.append(new ChannelInstruction(q, k));
+		}
+	}
+	for (unsigned int q : qubits) {
+		auto found = qubits_.find(q);
+		if (found == qubits_.end()) continue;
+		for (const vector<complex<double>>& k : found->second) routine.append(new ChannelInstruction(q, k));
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <complex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Routine;
+
+//noise of a device: channels applied to the qubits of a gate after it, attached to gates by name or to qubits.
+//a noise file has one channel per line (lines starting with # are comments):
+//	gate <name> <channel> <p>	after every gate of that name (* for every gate), on each of its qubits
+//	qubit <q> <channel> <p>		after every gate acting on qubit q, on q
+//where channel is one of
+//	depolarizing p			the qubit is replaced by the maximally mixed state with probability p
+//	amplitude_damping p		state 1 decays to 0 with probability p
+//	dephasing p				the coherences of the qubit shrink by a factor 1 - p
+class NoiseModel {
+private:
+	//Kraus operators of each channel (2x2 row-major, concatenated) following the gates of each name
+	std::unordered_map<std::string, std::vector<std::vector<std::complex<double>>>> gates_;
+
+	//Kraus operators of each channel following every gate on each qubit
+	std::unordered_map<unsigned int, std::vector<std::vector<std::complex<double>>>> qubits_;
+
+public:
+	//Kraus operators of given channel with probability p.
+	//throws runtime_error if the channel is unknown or p is not in [0, 1].
+	static std::vector<std::complex<double>> kraus(const std::string& channel, double p);
+
+	//adds the channels of file. throws runtime_error if the file cannot be read or a line is not a channel.
+	void load(const std::string& filename);
+
+	bool empty() const { return gates_.empty() && qubits_.empty(); }
+
+	//appends the channels following gate name applied to qubits to routine
+	void append(Routine& routine, const std::string& name, const std::vector<unsigned int>& qubits) const;
+};
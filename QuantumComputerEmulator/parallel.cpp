@@ -0,0 +1,102 @@
+#include "parallel.h"
+#include <algorithm>
+
+using namespace std;
+
+unique_ptr<ThreadPool> ThreadPool::instance_;
+
+size_t ThreadPool::serial_threshold = (size_t)1 << 14;
+
+//set while a thread works on a task, so that tasks started within it run on the same thread
+static thread_local bool in_task = false;
+
+//smallest chunk handed to a thread, so that chunks keep whole cache lines and amortize the atomic increment
+static const size_t min_chunk = 1024;
+
+ThreadPool::ThreadPool(unsigned int threads) : task_(nullptr), count_(0), chunk_(0), next_(0), generation_(0), running_(0), stop_(false) {
+	if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+	for (unsigned int i = 1; i < threads; i++) workers_.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lock(mutex_);
+		stop_ = true;
+	}
+	start_.notify_all();
+	for (thread& t : workers_) t.join();
+}
+
+void ThreadPool::run(size_t n, const function<void(size_t, size_t)>& f, size_t grain) {
+	if (workers_.empty() || n * grain < serial_threshold || in_task) {
+		f(0, n);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(mutex_);
+		task_ = &f;
+		count_ = n;
+		//a few chunks per thread balance the load without much contention on next_
+		chunk_ = max(max<size_t>(1, min_chunk / grain), n / (4 * threads()));
+		next_ = 0;
+		running_ = (unsigned int)workers_.size();
+		generation_++;
+	}
+	start_.notify_all();
+
+	execute();
+
+	unique_lock<mutex> lock(mutex_);
+	done_.wait(lock, [this] { return running_ == 0; });
+	task_ = nullptr;
+}
+
+void ThreadPool::execute() {
+	in_task = true;
+	size_t begin;
+	while ((begin = next_.fetch_add(chunk_)) < count_) (*task_)(begin, min(count_, begin + chunk_));
+	in_task = false;
+}
+
+void ThreadPool::work() {
+	unsigned int generation = 0;
+
+	while (true) {
+		{
+			unique_lock<mutex> lock(mutex_);
+			start_.wait(lock, [this, generation] { return stop_ || generation_ != generation; });
+			if (stop_) return;
+			generation = generation_;
+		}
+
+		execute();
+
+		lock_guard<mutex> lock(mutex_);
+		if (--running_ == 0) done_.notify_one();
+	}
+}
+
+//threads of the shared pool, started on its first use
+static unsigned int pool_threads = 1;
+
+ThreadPool& ThreadPool::instance() {
+	if (!instance_) instance_.reset(new ThreadPool(pool_threads));
+	return *instance_;
+}
+
+void ThreadPool::set_threads(unsigned int threads) {
+	instance_.reset();
+	pool_threads = threads;
+}
+
+double parallel_sum(size_t n, const function<double(size_t, size_t)>& f) {
+	double sum = 0;
+	mutex m;
+	parallel_for(n, [&](size_t begin, size_t end) {
+		double partial = f(begin, end);
+		lock_guard<mutex> lock(m);
+		sum += partial;
+	});
+	return sum;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+//a fixed set of worker threads splitting an index range [0, n) into chunks.
+//the calling thread works on the range too, so a pool of 1 thread has no workers.
+//ranges started from within a task are run by the thread working on it.
+class ThreadPool {
+private:
+	std::vector<std::thread> workers_;
+
+	std::mutex mutex_;
+	std::condition_variable start_;
+	std::condition_variable done_;
+
+	//current task, valid while running_ > 0
+	const std::function<void(size_t, size_t)>* task_;
+	size_t count_;
+	size_t chunk_;
+	std::atomic<size_t> next_;
+
+	unsigned int generation_; //incremented for every task, wakes the workers
+	unsigned int running_; //workers still working on current task
+	bool stop_;
+
+	static std::unique_ptr<ThreadPool> instance_;
+
+	void work();
+
+	void execute();
+
+public:
+	//ranges shorter than this are run by the calling thread alone
+	static size_t serial_threshold;
+
+	ThreadPool(unsigned int threads);
+
+	~ThreadPool();
+
+	unsigned int threads() const { return (unsigned int)workers_.size() + 1; }
+
+	//calls f(begin, end) on disjoint subranges covering [0, n), and returns when all are done.
+	//grain is the number of amplitudes each index stands for, for tasks over blocks of amplitudes.
+	void run(size_t n, const std::function<void(size_t, size_t)>& f, size_t grain = 1);
+
+	//pool used by the kernels of all registries
+	static ThreadPool& instance();
+
+	//replaces the shared pool with one of given number of threads (0 for one per hardware thread), started on its
+	//first use (so that processes forked before then start their own threads)
+	static void set_threads(unsigned int threads);
+};
+
+//calls f(begin, end) on subranges covering [0, n), in parallel on the shared pool
+inline void parallel_for(size_t n, const std::function<void(size_t, size_t)>& f, size_t grain = 1) { ThreadPool::instance().run(n, f, grain); }
+
+//returns sum of f(begin, end) over subranges covering [0, n), computed in parallel on the shared pool
+double parallel_sum(size_t n, const std::function<double(size_t, size_t)>& f);
@@ -0,0 +1,121 @@
+#include "parser.h"
+#include <charconv>
+#include <stdexcept>
+
+using namespace std;
+
+//splits a line into words, separated by whitespace (carriage returns of files written on windows included)
+class lexer {
+private:
+	string_view text_;
+	size_t pos_;
+
+	static bool space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f'; }
+
+public:
+	lexer(string_view text) : text_(text), pos_(0) {}
+
+	//sets word to the next word of the line, returns false if there is none
+	bool next(string_view& word) {
+		while (pos_ < text_.size() && space(text_[pos_])) pos_++;
+		if (pos_ == text_.size()) return false;
+		size_t start = pos_;
+		while (pos_ < text_.size() && !space(text_[pos_])) pos_++;
+		word = text_.substr(start, pos_ - start);
+		return true;
+	}
+};
+
+static void syntax_error() {
+	throw runtime_error("syntax error");
+}
+
+static bool identifier_start(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool identifier_char(char c) {
+	return identifier_start(c) || (c >= '0' && c <= '9');
+}
+
+bool qasm::parse_number(string_view word, double& value) {
+	//from_chars takes no leading plus
+	if (!word.empty() && word[0] == '+') word.remove_prefix(1);
+	if (word.empty()) return false;
+	from_chars_result r = from_chars(word.data(), word.data() + word.size(), value);
+	return r.ec == errc() && r.ptr == word.data() + word.size();
+}
+
+bool qasm::parse_index(string_view word, unsigned int& value) {
+	if (word.empty()) return false;
+	from_chars_result r = from_chars(word.data(), word.data() + word.size(), value);
+	return r.ec == errc() && r.ptr == word.data() + word.size();
+}
+
+//param := number | identifier, ending at a comma or closing paranthesis
+static qasm::param_token parse_param(string_view text) {
+	qasm::param_token p = { string_view(), 0 };
+	if (text.empty()) syntax_error();
+	if (identifier_start(text[0])) {
+		for (char c : text) if (!identifier_char(c)) syntax_error();
+		p.name = text;
+	}
+	else if (!qasm::parse_number(text, p.value)) syntax_error();
+	return p;
+}
+
+//call := name ["(" param {"," param} ")"], the whole of word
+static void parse_call(string_view word, qasm::statement& s) {
+	size_t open = word.find('(');
+	s.name = word.substr(0, open);
+	if (s.name.empty() || s.name.find_first_of("),") != string_view::npos) syntax_error();
+	if (open == string_view::npos) return;
+
+	//parameters run to the closing paranthesis, which must end the word
+	if (word.back() != ')') syntax_error();
+	string_view list = word.substr(open + 1, word.size() - open - 2);
+	while (true) {
+		size_t comma = list.find(',');
+		string_view param = list.substr(0, comma);
+		if (param.find_first_of("()") != string_view::npos) syntax_error();
+		s.params.push_back(parse_param(param));
+		if (comma == string_view::npos) break;
+		list.remove_prefix(comma + 1);
+	}
+}
+
+void qasm::parse(string_view line, statement& s) {
+	s.kind = statement_kind::empty;
+	s.name = string_view();
+	s.params.clear();
+	s.args.clear();
+
+	lexer words(line);
+	string_view word;
+	if (!words.next(word)) return;
+
+	if (word == "qubits") s.kind = statement_kind::qubits;
+	else if (word == "measure") s.kind = statement_kind::measure;
+	else if (word == "include") s.kind = statement_kind::include;
+	else if (word == "}") s.kind = statement_kind::end;
+	else if (word == "gate") {
+		//gate call word... "{", the parameters of the call being names
+		s.kind = statement_kind::define;
+		if (!words.next(word)) syntax_error();
+		parse_call(word, s);
+		for (const param_token& p : s.params) if (p.name.empty()) syntax_error();
+	}
+	else {
+		s.kind = statement_kind::call;
+		parse_call(word, s);
+	}
+
+	while (words.next(word)) s.args.push_back(word);
+
+	if (s.kind == statement_kind::define) {
+		if (s.args.empty() || s.args.back() != "{") syntax_error();
+		s.args.pop_back();
+		for (string_view a : s.args) if (a.find('{') != string_view::npos) syntax_error();
+	}
+	if (s.kind == statement_kind::end && !s.args.empty()) syntax_error();
+}
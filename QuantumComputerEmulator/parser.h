@@ -0,0 +1,46 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+//lexer and recursive-descent parser of the lines of myqasm files. a line is read in a single pass into views of its
+//text, and the vectors of a statement keep their capacity, so parsing line after line into the same statement
+//allocates no memory.
+//
+//	statement	:= "qubits" word | "measure" [word] | "include" word | "gate" call word... "{" | "}" | call word...
+//	call		:= name ["(" param {"," param} ")"]
+//	param		:= number | identifier
+//
+//words are separated by whitespace, so a call (with its parameters) must not contain any. the words following a
+//call are its arguments: qubit indices, or in the body of a gate definition the names of its arguments.
+namespace qasm {
+	enum class statement_kind { empty, qubits, measure, include, define, end, call };
+
+	//a parameter of a call: a number, or the name of a parameter of the gate being defined
+	struct param_token {
+		//empty for numbers
+		std::string_view name;
+		double value;
+	};
+
+	struct statement {
+		statement_kind kind = statement_kind::empty;
+
+		//gate called or defined
+		std::string_view name;
+
+		std::vector<param_token> params;
+
+		//words following the keyword or call (for a definition, its arguments without the "{")
+		std::vector<std::string_view> args;
+	};
+
+	//parses line into s. the views of s point into line, and are valid as long as its text is.
+	//throws runtime_error("syntax error") if line is not a statement.
+	void parse(std::string_view line, statement& s);
+
+	//parses word as a number, returns false if it is not one
+	bool parse_number(std::string_view word, double& value);
+
+	//parses word as a non-negative integer (a qubit or size), returns false if it is not one or is out of range
+	bool parse_index(std::string_view word, unsigned int& value);
+}
@@ -1,108 +1,1374 @@
 #include "quantum.h"
+#include "parallel.h"
+#include "kernels.h"
+#include "random.h"
+#include "distributed.h"
+#include "sparse.h"
+#include "stabilizer.h"
+#include "mps.h"
+#include "density.h"
 #include <complex>
 #include <cmath>
 #include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+#include <numeric>
+#include <mutex>
 
 using namespace std;
 
-bool bit(int n, int b) {
-	if (b == 0) return (n % 2 == 1);
-	return bit(n / 2, b - 1);
+//alignment of state vector, enough for a cache line and any vector register
+static const size_t alignment = 64;
+
+size_t Registry::memory_budget_ = (size_t)8 << 30;
+
+bool Registry::single_precision = false;
+
+Layout Registry::layout = Layout::interleaved;
+
+bool Registry::stabilizer = true;
+
+bool Registry::density = false;
+
+double Registry::sparse_fill = 1.0 / 64;
+
+unsigned int Registry::mps_bond = 0;
+
+double Registry::mps_truncation = 0;
+
+size_t Registry::cache_size = (size_t)512 << 10;
+
+Registry* Registry::create(unsigned int size, bool clifford) {
+	if (clifford && stabilizer) return new StabilizerRegistry(size);
+	if (density) {
+		if (single_precision) return new DensityRegistry<float>(size, layout);
+		return new DensityRegistry<double>(size, layout);
+	}
+	if (mps_bond > 0) return new MpsRegistry(size, mps_bond, mps_truncation);
+
+	//registries too small to split over the ranks are held whole by each rank, which all compute the same
+	if (distributable(size)) {
+		if (single_precision) return new DistributedRegistry<float>(size, layout);
+		return new DistributedRegistry<double>(size, layout);
+	}
+	if (sparse_fill > 0) {
+		if (single_precision) return new SparseRegistry<float>(size, layout);
+		return new SparseRegistry<double>(size, layout);
+	}
+	if (single_precision) return new QRegistryF(size, layout);
+	return new QRegistry(size, layout);
+}
+
+template<typename T>
+static complex<T>* aligned_alloc_amplitudes(size_t count) {
+	void* p = nullptr;
+#ifdef _MSC_VER
+	p = _aligned_malloc(count * sizeof(complex<T>), alignment);
+#else
+	if (posix_memalign(&p, alignment, count * sizeof(complex<T>)) != 0) p = nullptr;
+#endif
+	if (p == nullptr) throw bad_alloc();
+	return static_cast<complex<T>*>(p);
 }
 
-void GateInstruction::operator()(QRegistry& registry) const {
-	if (this->size() > registry.size()) throw runtime_error("registry not large enough");
-	
-	int pw = (int) pow(2, registry.size());
-	
-	complex<double>* rstate = registry.registry;
-	complex<double>* new_rstate = new complex<double>[pw];
+static void aligned_free_amplitudes(void* p) {
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+//views of the amplitudes of a registry, accessing single amplitudes the same way in either layout
+
+//amplitudes stored as std::complex<T>
+template<typename T>
+struct interleaved_view {
+	complex<T>* p;
 
-	for (int i = 0; i < pw; i++) new_rstate[i] = 0;
+	T norm(size_t i) const { return std::norm(p[i]); }
+	complex<T> get(size_t i) const { return p[i]; }
+	void set(size_t i, complex<T> a) const { p[i] = a; }
+	void scale(size_t i, T s) const { p[i] *= s; }
+	void zero(size_t begin, size_t end) const { fill(p + begin, p + end, complex<T>(0)); }
+};
 
-	int q = target_;
-	Gate gate = gate_;
+//real parts in re, imaginary parts in im
+template<typename T>
+struct split_view {
+	T* re;
+	T* im;
 
+	T norm(size_t i) const { return re[i] * re[i] + im[i] * im[i]; }
+	complex<T> get(size_t i) const { return complex<T>(re[i], im[i]); }
+	void set(size_t i, complex<T> a) const { re[i] = a.real(); im[i] = a.imag(); }
+	void scale(size_t i, T s) const { re[i] *= s; im[i] *= s; }
+	void zero(size_t begin, size_t end) const { fill(re + begin, re + end, T(0)); fill(im + begin, im + end, T(0)); }
+};
+
+template<typename T>
+template<typename F>
+auto BasicQRegistry<T>::view(const F& f) const {
+	if (layout_ == Layout::split) return f(split_view<T>{ reinterpret_cast<T*>(registry), imag_ });
+	return f(interleaved_view<T>{ registry });
+}
 
-	for (int i = 0; i < pw; i++) {
-		if (bit(i, q)) {
-			new_rstate[i] += rstate[i] * gate.state1()->state1();
-			new_rstate[i - (int)pow(2, q)] += rstate[i] * gate.state1()->state0();
-		} else {
-			new_rstate[i + (int)pow(2, q)] += rstate[i] * gate.state0()->state1();
-			new_rstate[i] += rstate[i] * gate.state0()->state0();
+template<typename T>
+BasicQRegistry<T>::BasicQRegistry(unsigned int size, Layout layout)
+	: Registry(size), registry(nullptr), imag_(nullptr), layout_(layout), owner_(true) {
+	//2^size amplitudes of 8 or 16 bytes each must be addressable and within budget
+	if (size >= sizeof(size_t) * 8 - 4) throw memory_exception(size, memory_budget_);
+	if ((sizeof(complex<T>) << size) > memory_budget_) throw memory_exception(size, memory_budget_);
+
+	registry = aligned_alloc_amplitudes<T>(length());
+	if (layout_ == Layout::split) imag_ = reinterpret_cast<T*>(registry) + length();
+	reset();
+}
+
+template<typename T>
+void BasicQRegistry<T>::reset() {
+	view([this](auto v) {
+		parallel_for(length(), [v](size_t begin, size_t end) { v.zero(begin, end); });
+		v.set(0, 1);
+	});
+}
+
+template<typename T>
+complex<double> BasicQRegistry<T>::amplitude(size_t i) const {
+	return view([i](auto v) { return complex<double>(v.get(i)); });
+}
+
+template<typename T>
+BasicQRegistry<T>::~BasicQRegistry() {
+	if (owner_ && registry != nullptr) aligned_free_amplitudes(registry);
+}
+
+void GateInstruction::operator()(Registry& registry) const {
+	if (this->size() >= registry.size()) throw runtime_error("registry not large enough");
+
+	registry.apply(target_, matrix_);
+}
+
+void CGateInstruction::operator()(Registry& registry) const {
+	if (this->size() >= registry.size()) throw runtime_error("registry not large enough");
+	if (control_ == target_) throw runtime_error("error: control qubit must be different from target qubit");
+
+	registry.apply_controlled(control_, target_, matrix_);
+}
+
+void CGateInstruction::matrix(complex<double>* m) const {
+	//bit 0 of indices is control, bit 1 is target: identity unless control is 1
+	fill(m, m + 16, complex<double>(0));
+	m[0 * 4 + 0] = 1;
+	m[2 * 4 + 2] = 1;
+	for (int r = 0; r < 2; r++) {
+		for (int c = 0; c < 2; c++) m[(1 | r << 1) * 4 + (1 | c << 1)] = matrix_[r * 2 + c];
+	}
+}
+
+//writes the 2^(c + 1) x 2^(c + 1) matrix applying 2x2 matrix m to bit c of indices where bits 0 to c - 1 are all 1
+static void multi_controlled_matrix(size_t c, const complex<double>* m, complex<double>* out) {
+	size_t dim = (size_t)2 << c;
+	size_t bit = (size_t)1 << c;
+	size_t all = bit - 1;
+	fill(out, out + dim * dim, complex<double>(0));
+	for (size_t i = 0; i < all; i++) out[i * dim + i] = out[(i | bit) * dim + (i | bit)] = 1;
+	for (size_t r = 0; r < 2; r++) {
+		for (size_t col = 0; col < 2; col++) out[(all | r << c) * dim + (all | col << c)] = m[r * 2 + col];
+	}
+}
+
+void MultiControlledInstruction::operator()(Registry& registry) const {
+	if (this->size() >= registry.size()) throw runtime_error("registry not large enough");
+	for (size_t i = 0; i < controls_.size(); i++) {
+		if (controls_[i] == target_) throw runtime_error("error: control qubit must be different from target qubit");
+		if (find(controls_.begin(), controls_.begin() + i, controls_[i]) != controls_.begin() + i) {
+			throw runtime_error("error: control qubits must be distinct");
+		}
+	}
+
+	registry.apply_multi_controlled(controls_, target_, matrix_);
+}
+
+unsigned int MultiControlledInstruction::size() const {
+	unsigned int s = target_;
+	for (unsigned int c : controls_) s = max(s, c);
+	return s;
+}
+
+vector<unsigned int> MultiControlledInstruction::qubits() const {
+	vector<unsigned int> q(controls_);
+	q.push_back(target_);
+	return q;
+}
+
+void MultiControlledInstruction::matrix(complex<double>* m) const {
+	multi_controlled_matrix(controls_.size(), matrix_, m);
+}
+
+unique_ptr<Instruction> MultiControlledInstruction::remapped(const vector<unsigned int>& map) const {
+	vector<unsigned int> controls;
+	for (unsigned int c : controls_) controls.push_back(map[c]);
+	return unique_ptr<Instruction>(new MultiControlledInstruction(controls, map[target_], matrix_));
+}
+
+void UnitaryInstruction::operator()(Registry& registry) const {
+	if (this->size() >= registry.size()) throw runtime_error("registry not large enough");
+
+	registry.apply_unitary(qubits_, matrix_.data());
+}
+
+bool MeasureInstruction::verbose = true;
+
+void MeasureInstruction::operator()(Registry& registry) const {
+	bool value = registry.measure(target_);
+	if (verbose) cout << value << endl;
+}
+
+void ChannelInstruction::operator()(Registry& registry) const {
+	registry.apply_channel(target_, kraus_);
+}
+
+unsigned int UnitaryInstruction::size() const {
+	return *max_element(qubits_.begin(), qubits_.end());
+}
+
+unique_ptr<Instruction> UnitaryInstruction::remapped(const vector<unsigned int>& map) const {
+	vector<unsigned int> qubits;
+	for (unsigned int q : qubits_) qubits.push_back(map[q]);
+	return unique_ptr<Instruction>(new UnitaryInstruction(qubits, matrix_));
+}
+
+void SwapInstruction::operator()(Registry& registry) const {
+	if (this->size() >= registry.size()) throw runtime_error("registry not large enough");
+
+	registry.swap_qubits(pairs_);
+}
+
+unsigned int SwapInstruction::size() const {
+	unsigned int size = 0;
+	for (const pair<unsigned int, unsigned int>& p : pairs_) size = max(size, max(p.first, p.second));
+	return size;
+}
+
+vector<unsigned int> SwapInstruction::qubits() const {
+	vector<unsigned int> qubits;
+	for (const pair<unsigned int, unsigned int>& p : pairs_) {
+		qubits.push_back(p.first);
+		qubits.push_back(p.second);
+	}
+	return qubits;
+}
+
+void SwapInstruction::matrix(complex<double>* m) const {
+	//bits 2j and 2j + 1 of indices are pair j: a permutation matrix exchanging them
+	size_t dim = (size_t)1 << (2 * pairs_.size());
+	fill(m, m + dim * dim, complex<double>(0));
+	for (size_t c = 0; c < dim; c++) {
+		size_t r = c;
+		for (size_t j = 0; j < pairs_.size(); j++) {
+			if (((c >> (2 * j)) ^ (c >> (2 * j + 1))) & 1) r ^= (size_t)3 << (2 * j);
 		}
+		m[r * dim + c] = 1;
 	}
+}
 
-	delete[] rstate;
-	registry.registry = new_rstate;
+unique_ptr<Instruction> SwapInstruction::remapped(const vector<unsigned int>& map) const {
+	vector<pair<unsigned int, unsigned int>> pairs;
+	for (const pair<unsigned int, unsigned int>& p : pairs_) pairs.emplace_back(map[p.first], map[p.second]);
+	return unique_ptr<Instruction>(new SwapInstruction(pairs));
 }
 
-void CGateInstruction::operator()(QRegistry& registry) const {
-	if (this->size() > registry.size()) throw runtime_error("registry not large enough");
-	
-	int pw = (int)pow(2, registry.size());
+string Registry::measure_bits() {
+	uint64_t value = measure_all();
+	string bits(size_, '0');
+	for (unsigned int q = 0; q < size_ && q < 64; q++) if ((value >> q) & 1) bits[size_ - 1 - q] = '1';
+	return bits;
+}
 
-	complex<double>* rstate = registry.registry;
-	complex<double>* new_rstate = new complex<double>[pw];
+map<string, size_t> Registry::sample_bits(size_t shots) const {
+	map<string, size_t> counts;
+	for (const pair<const uint64_t, size_t>& c : sample(shots)) {
+		string bits(size_, '0');
+		for (unsigned int q = 0; q < size_ && q < 64; q++) if ((c.first >> q) & 1) bits[size_ - 1 - q] = '1';
+		counts[bits] += c.second;
+	}
+	return counts;
+}
 
-	for (int i = 0; i < pw; i++) new_rstate[i] = 0;
+void Registry::apply_multi_controlled(const vector<unsigned int>& controls, unsigned int target, const complex<double>* m) {
+	if (controls.empty()) return apply(target, m);
+	if (controls.size() == 1) return apply_controlled(controls[0], target, m);
+	if (controls.size() >= max_unitary_qubits) throw runtime_error("error: unitary on too many qubits");
 
-	int c = control_;
-	int q = target_;
-	CGate gate = gate_;
+	vector<unsigned int> qubits(controls);
+	qubits.push_back(target);
+	size_t dim = (size_t)1 << qubits.size();
+	vector<complex<double>> u(dim * dim);
+	multi_controlled_matrix(controls.size(), m, u.data());
+	apply_unitary(qubits, u.data());
+}
 
-	if (c == q) throw runtime_error("error: control qubit must be different from target qubit");
+void Registry::apply_channel(unsigned int target, const vector<complex<double>>& kraus) {
+	if (target >= size_) throw runtime_error("registry not large enough");
 
-	for (int i = 0; i < pw; i++) {
-		if (!bit(i, c)) {
-			new_rstate[i] += rstate[i];
+	complex<double> rho[4];
+	reduced(target, rho);
+	apply(target, draw_kraus(kraus, rho, rng::local().uniform()).data());
+}
+
+void Registry::reduced(unsigned int, complex<double>*) {
+	throw runtime_error("error: noise channels are not supported by this registry");
+}
+
+double Registry::pauli_expectation(uint64_t, uint64_t, unsigned int) const {
+	throw runtime_error("error: expectation values are not supported by this registry");
+}
+
+vector<complex<double>> Registry::draw_kraus(const vector<complex<double>>& kraus, const complex<double>* rho, double u) {
+	//outcome of operator m has probability tr(m rho m^H)
+	size_t count = kraus.size() / 4;
+	vector<double> p(count, 0);
+	for (size_t k = 0; k < count; k++) {
+		const complex<double>* m = &kraus[4 * k];
+		for (int r = 0; r < 2; r++) {
+			for (int c = 0; c < 2; c++) {
+				for (int d = 0; d < 2; d++) p[k] += (m[r * 2 + c] * rho[c * 2 + d] * conj(m[r * 2 + d])).real();
+			}
+		}
+	}
+
+	//u is scaled to the sum of the probabilities, which is the norm of the state up to rounding
+	double x = u * accumulate(p.begin(), p.end(), 0.0);
+	size_t k = 0;
+	while (k + 1 < count && x >= p[k]) x -= p[k++];
+	while (k > 0 && p[k] <= 0) k--;
+
+	vector<complex<double>> m(kraus.begin() + 4 * k, kraus.begin() + 4 * k + 4);
+	double scale = 1 / sqrt(p[k]);
+	for (complex<double>& e : m) e *= scale;
+	return m;
+}
+
+void Registry::swap_qubits(const vector<pair<unsigned int, unsigned int>>& pairs) {
+	complex<double> m[16];
+	SwapInstruction(0, 1).matrix(m);
+	for (const pair<unsigned int, unsigned int>& p : pairs) apply_unitary({ p.first, p.second }, m);
+}
+
+//inserts a 0 bit into k at position b
+static inline size_t insert_zero(size_t k, unsigned int b) {
+	size_t low = ((size_t)1 << b) - 1;
+	return ((k & ~low) << 1) | (k & low);
+}
+
+GateKind classify(const complex<double>* m) {
+	if (m[1] == 0.0 && m[2] == 0.0) return GateKind::diagonal;
+	if (m[0] == 0.0 && m[3] == 0.0) return GateKind::antidiagonal;
+	return GateKind::general;
+}
+
+//calls f(i, n) in parallel for runs of n consecutive pairs covering all pairs of target qubit.
+//for target above 0 the run is pairs (i + j, i + j + 2^target), for target 0 it is pairs (i + 2j, i + 2j + 1).
+template<typename F>
+static void for_each_run(size_t length, unsigned int target, const F& f) {
+	//pair k is (i, i + 2^target), where i is k with a 0 inserted at target
+	if (target == 0) {
+		parallel_for(length / 2, [&](size_t begin, size_t end) { f(2 * begin, end - begin); });
+		return;
+	}
+
+	size_t stride = (size_t)1 << target;
+	parallel_for(length / 2, [&](size_t begin, size_t end) {
+		size_t k = begin;
+		while (k < end) {
+			size_t run_end = min(end, (k | (stride - 1)) + 1);
+			f(insert_zero(k, target), run_end - k);
+			k = run_end;
+		}
+	});
+}
+
+//same as for_each_run, for the pairs of target qubit in states where control qubit is 1
+template<typename F>
+static void for_each_controlled_run(size_t length, unsigned int control, unsigned int target, const F& f) {
+	size_t cmask = (size_t)1 << control;
+	unsigned int lo = min(control, target);
+	unsigned int hi = max(control, target);
+
+	//k runs over states with control and target qubits both 0 (2 bits removed), contiguous within runs below bit lo.
+	//for target 0 the pairs are adjacent, and contiguous within runs below bit hi instead.
+	if (target == 0) {
+		size_t run = (size_t)1 << (hi - 1);
+		parallel_for(length / 4, [&](size_t begin, size_t end) {
+			size_t k = begin;
+			while (k < end) {
+				size_t run_end = min(end, (k | (run - 1)) + 1);
+				f(insert_zero(2 * k, hi) | cmask, run_end - k);
+				k = run_end;
+			}
+		});
+		return;
+	}
+
+	size_t run = (size_t)1 << lo;
+	parallel_for(length / 4, [&](size_t begin, size_t end) {
+		size_t k = begin;
+		while (k < end) {
+			size_t run_end = min(end, (k | (run - 1)) + 1);
+			f(insert_zero(insert_zero(k, lo), hi) | cmask, run_end - k);
+			k = run_end;
+		}
+	});
+}
+
+//same as for_each_run, for the pairs of target qubit in states where all control qubits (in cmask) are 1. sorted
+//holds the controls and target in increasing order.
+template<typename F>
+static void for_each_multi_controlled_run(size_t length, const vector<unsigned int>& sorted, size_t cmask, unsigned int target,
+	const F& f) {
+	//k runs over states with all of sorted 0, contiguous within runs below the lowest of them. for target 0 the
+	//pairs are adjacent, and contiguous within runs below the next lowest instead.
+	size_t groups = length >> sorted.size();
+	size_t run = (size_t)1 << sorted[0];
+	if (target == 0) run = (sorted.size() > 1) ? (size_t)1 << (sorted[1] - 1) : groups;
+
+	parallel_for(groups, [&](size_t begin, size_t end) {
+		size_t k = begin;
+		while (k < end) {
+			size_t run_end = min(end, (k | (run - 1)) + 1);
+			size_t i = k;
+			for (unsigned int q : sorted) i = insert_zero(i, q);
+			f(i | cmask, run_end - k);
+			k = run_end;
+		}
+	});
+}
+
+//applies m to the runs of pairs enumerated by for_runs, with the cheapest update for the structure of m:
+//diagonal gates only multiply amplitudes by entries other than 1, and antidiagonal gates (e.g. not) swap
+//the halves without arithmetic when their entries are 1.
+template<typename T, typename Runs>
+static void apply_runs(interleaved_view<T> v, unsigned int target, const complex<double>* md, const Runs& for_runs) {
+	complex<T>* state = v.p;
+	size_t stride = (size_t)1 << target;
+	const kernels::kernel_set<T>& kernel = kernels::active<T>();
+	const complex<T> one(1);
+	const complex<T> m[4] = { complex<T>(md[0]), complex<T>(md[1]), complex<T>(md[2]), complex<T>(md[3]) };
+
+	switch (classify(md)) {
+	case GateKind::diagonal: {
+		const complex<T> d[2] = { m[0], m[3] };
+		if (d[0] == one && d[1] == one) return;
+
+		if (target == 0) for_runs([&](size_t i, size_t n) { kernel.diagonal_low(state + i, n, d); });
+		else for_runs([&](size_t i, size_t n) {
+			if (d[0] != one) kernel.scale(state + i, n, &d[0]);
+			if (d[1] != one) kernel.scale(state + i + stride, n, &d[1]);
+		});
+		return;
+	}
+
+	case GateKind::antidiagonal: {
+		const complex<T> d[2] = { m[1], m[2] };
+		bool scale = d[0] != one || d[1] != one;
+
+		if (target == 0) for_runs([&](size_t i, size_t n) {
+			complex<T>* p = state + i;
+			for (size_t j = 0; j < n; j++) swap(p[2 * j], p[2 * j + 1]);
+			if (scale) kernel.diagonal_low(p, n, d);
+		});
+		else for_runs([&](size_t i, size_t n) {
+			swap_ranges(state + i, state + i + n, state + i + stride);
+			if (d[0] != one) kernel.scale(state + i, n, &d[0]);
+			if (d[1] != one) kernel.scale(state + i + stride, n, &d[1]);
+		});
+		return;
+	}
+
+	default:
+		if (target == 0) for_runs([&](size_t i, size_t n) { kernel.low(state + i, n, m); });
+		else for_runs([&](size_t i, size_t n) { kernel.high(state + i, state + i + stride, n, m); });
+	}
+}
+
+//same as apply_runs on interleaved amplitudes, with the kernels for split real and imaginary parts
+template<typename T, typename Runs>
+static void apply_runs(split_view<T> v, unsigned int target, const complex<double>* md, const Runs& for_runs) {
+	T* re = v.re;
+	T* im = v.im;
+	size_t stride = (size_t)1 << target;
+	const kernels::split_kernel_set<T>& kernel = kernels::active_split<T>();
+	const complex<T> one(1);
+	const complex<T> m[4] = { complex<T>(md[0]), complex<T>(md[1]), complex<T>(md[2]), complex<T>(md[3]) };
+
+	switch (classify(md)) {
+	case GateKind::diagonal: {
+		const complex<T> d[2] = { m[0], m[3] };
+		if (d[0] == one && d[1] == one) return;
+
+		if (target == 0) for_runs([&](size_t i, size_t n) { kernel.diagonal_low(re + i, im + i, n, d); });
+		else for_runs([&](size_t i, size_t n) {
+			if (d[0] != one) kernel.scale(re + i, im + i, n, &d[0]);
+			if (d[1] != one) kernel.scale(re + i + stride, im + i + stride, n, &d[1]);
+		});
+		return;
+	}
+
+	case GateKind::antidiagonal: {
+		const complex<T> d[2] = { m[1], m[2] };
+		bool scale = d[0] != one || d[1] != one;
+
+		if (target == 0) for_runs([&](size_t i, size_t n) {
+			for (size_t j = 0; j < n; j++) {
+				swap(re[i + 2 * j], re[i + 2 * j + 1]);
+				swap(im[i + 2 * j], im[i + 2 * j + 1]);
+			}
+			if (scale) kernel.diagonal_low(re + i, im + i, n, d);
+		});
+		else for_runs([&](size_t i, size_t n) {
+			swap_ranges(re + i, re + i + n, re + i + stride);
+			swap_ranges(im + i, im + i + n, im + i + stride);
+			if (d[0] != one) kernel.scale(re + i, im + i, n, &d[0]);
+			if (d[1] != one) kernel.scale(re + i + stride, im + i + stride, n, &d[1]);
+		});
+		return;
+	}
+
+	default:
+		if (target == 0) for_runs([&](size_t i, size_t n) { kernel.low(re + i, im + i, n, m); });
+		else for_runs([&](size_t i, size_t n) { kernel.high(re + i, im + i, re + i + stride, im + i + stride, n, m); });
+	}
+}
+
+template<typename T>
+void BasicQRegistry<T>::apply(unsigned int target, const complex<double>* m) {
+	size_t pw = length();
+	view([=](auto v) {
+		apply_runs(v, target, m, [pw, target](const auto& f) {
+			for_each_run(pw, target, f);
+		});
+	});
+}
+
+template<typename T>
+void BasicQRegistry<T>::apply_controlled(unsigned int control, unsigned int target, const complex<double>* m) {
+	size_t pw = length();
+	view([=](auto v) {
+		apply_runs(v, target, m, [pw, control, target](const auto& f) {
+			for_each_controlled_run(pw, control, target, f);
+		});
+	});
+}
+
+template<typename T>
+void BasicQRegistry<T>::apply_multi_controlled(const vector<unsigned int>& controls, unsigned int target, const complex<double>* m) {
+	size_t pw = length();
+	size_t cmask = 0;
+	vector<unsigned int> sorted(controls);
+	for (unsigned int c : controls) cmask |= (size_t)1 << c;
+	sorted.push_back(target);
+	sort(sorted.begin(), sorted.end());
+
+	view([&](auto v) {
+		apply_runs(v, target, m, [pw, cmask, target, &sorted](const auto& f) {
+			for_each_multi_controlled_run(pw, sorted, cmask, target, f);
+		});
+	});
+}
+
+unsigned int Routine::fusion_width = 3;
+
+//expands matrix g acting on qubits gq to a matrix acting on qubits u (a superset of gq), as identity on the others
+static vector<complex<double>> expand(const vector<complex<double>>& g, const vector<unsigned int>& gq, const vector<unsigned int>& u) {
+	size_t gdim = (size_t)1 << gq.size();
+	size_t dim = (size_t)1 << u.size();
+
+	//pos[j] is bit of qubit gq[j] in indices of expanded matrix
+	vector<unsigned int> pos;
+	size_t gmask = 0;
+	for (unsigned int q : gq) {
+		pos.push_back((unsigned int)(find(u.begin(), u.end(), q) - u.begin()));
+		gmask |= (size_t)1 << pos.back();
+	}
+
+	auto sub = [&pos](size_t i) {
+		size_t k = 0;
+		for (size_t j = 0; j < pos.size(); j++) k |= ((i >> pos[j]) & 1) << j;
+		return k;
+	};
+
+	vector<complex<double>> e(dim * dim, 0);
+	for (size_t r = 0; r < dim; r++) {
+		for (size_t c = 0; c < dim; c++) {
+			if ((r & ~gmask) == (c & ~gmask)) e[r * dim + c] = g[sub(r) * gdim + sub(c)];
+		}
+	}
+
+	return e;
+}
+
+//product a * b of dim x dim matrices, skipping the zeros of a (gates expanded to more qubits are mostly zeros)
+static vector<complex<double>> multiply(const vector<complex<double>>& a, const vector<complex<double>>& b, size_t dim) {
+	vector<complex<double>> product(dim * dim, 0);
+	for (size_t r = 0; r < dim; r++) {
+		for (size_t k = 0; k < dim; k++) {
+			if (a[r * dim + k] == 0.0) continue;
+			for (size_t c = 0; c < dim; c++) product[r * dim + c] += a[r * dim + k] * b[k * dim + c];
+		}
+	}
+	return product;
+}
+
+size_t Routine::fuse(unsigned int max_width) {
+	max_width = min(max_width, Registry::max_unitary_qubits);
+	size_t count = instructions.size();
+
+	list<unique_ptr<Instruction>> fused;
+	list<unique_ptr<Instruction>> pending; //instructions merged into current block
+	vector<unsigned int> qubits; //qubits of current block
+	vector<complex<double>> block; //product of pending instructions, on qubits
+
+	//a block of a single instruction keeps it, since its own kernel is at least as fast as a dense one
+	auto flush = [&]() {
+		if (pending.size() == 1) fused.push_back(move(pending.front()));
+		else if (pending.size() > 1) fused.push_back(unique_ptr<Instruction>(new UnitaryInstruction(qubits, block)));
+		pending.clear();
+		qubits.clear();
+		block.clear();
+	};
+
+	for (unique_ptr<Instruction>& it : instructions) {
+		vector<unsigned int> q = it->qubits();
+		if (q.size() > max_width || !it->unitary()) {
+			flush();
+			fused.push_back(move(it));
 			continue;
-		} else {
-			if (bit(i, q)) {
-				new_rstate[i] += rstate[i] * gate.transform().state1()->state1();
-				new_rstate[i - (int)pow(2, q)] += rstate[i] * gate.transform().state1()->state0();
+		}
+
+		vector<unsigned int> u = qubits;
+		for (unsigned int i : q) if (find(u.begin(), u.end(), i) == u.end()) u.push_back(i);
+		if (u.size() > max_width) {
+			flush();
+			u = q;
+		}
+
+		size_t dim = (size_t)1 << u.size();
+		if (block.empty()) {
+			block.assign(dim * dim, 0);
+			for (size_t i = 0; i < dim; i++) block[i * dim + i] = 1;
+		}
+		else block = expand(block, qubits, u);
+
+		vector<complex<double>> g((size_t)1 << (2 * q.size()));
+		it->matrix(g.data());
+		g = expand(g, q, u);
+
+		block = multiply(g, block, dim);
+		qubits = u;
+		pending.push_back(move(it));
+	}
+	flush();
+
+	instructions = move(fused);
+	return count - instructions.size();
+}
+
+//true if dim x dim matrix m is the identity, up to rounding
+static bool identity(const vector<complex<double>>& m, size_t dim) {
+	for (size_t r = 0; r < dim; r++) {
+		for (size_t c = 0; c < dim; c++) if (abs(m[r * dim + c] - ((r == c) ? 1.0 : 0.0)) > 1e-12) return false;
+	}
+	return true;
+}
+
+//matrix of unitary instruction i expanded to qubits u (a superset of its qubits)
+static vector<complex<double>> expanded_matrix(const Instruction& i, const vector<unsigned int>& u) {
+	vector<unsigned int> q = i.qubits();
+	vector<complex<double>> m((size_t)1 << (2 * q.size()));
+	i.matrix(m.data());
+	return expand(m, q, u);
+}
+
+//true if unitary instructions a and b give the same result in either order
+static bool commute(const Instruction& a, const Instruction& b) {
+	if (!a.unitary() || !b.unitary()) return false;
+
+	vector<unsigned int> u = a.qubits();
+	for (unsigned int q : b.qubits()) if (find(u.begin(), u.end(), q) == u.end()) u.push_back(q);
+	if (u.size() > Registry::max_unitary_qubits) return false;
+
+	size_t dim = (size_t)1 << u.size();
+	vector<complex<double>> ma = expanded_matrix(a, u), mb = expanded_matrix(b, u);
+	vector<complex<double>> ab = multiply(ma, mb, dim), ba = multiply(mb, ma, dim);
+	for (size_t j = 0; j < dim * dim; j++) if (abs(ab[j] - ba[j]) > 1e-12) return false;
+	return true;
+}
+
+//merges unitary instruction a followed by b, acting on the same qubits, into their product. returns false if
+//the product would not be an instruction of the kind of both (so that merging keeps their kernel), else sets
+//product to it, or to null if it is the identity.
+static bool merge(const Instruction& a, const Instruction& b, unique_ptr<Instruction>& product) {
+	vector<unsigned int> q = b.qubits(), pq = a.qubits();
+	if (!a.unitary() || !b.unitary() || pq.size() != q.size() || q.size() > Registry::max_unitary_qubits) return false;
+	for (unsigned int i : pq) if (find(q.begin(), q.end(), i) == q.end()) return false;
+
+	size_t dim = (size_t)1 << q.size();
+	vector<complex<double>> mb(dim * dim);
+	b.matrix(mb.data());
+	vector<complex<double>> m = multiply(mb, expanded_matrix(a, q), dim);
+	if (identity(m, dim)) {
+		product.reset();
+		return true;
+	}
+
+	//the 2x2 block of m where all qubits but the last (the controls) are 1
+	size_t all = dim / 2 - 1;
+	complex<double> g[4];
+	for (size_t r = 0; r < 2; r++) {
+		for (size_t c = 0; c < 2; c++) g[r * 2 + c] = m[(all | r * dim / 2) * dim + (all | c * dim / 2)];
+	}
+
+	if (dynamic_cast<const GateInstruction*>(&a) != nullptr && dynamic_cast<const GateInstruction*>(&b) != nullptr) {
+		product.reset(new GateInstruction(m.data(), q[0]));
+		return true;
+	}
+	if (dynamic_cast<const CGateInstruction*>(&a) != nullptr && dynamic_cast<const CGateInstruction*>(&b) != nullptr) {
+		if (pq[0] != q[0]) return false;
+		product.reset(new CGateInstruction(g, q[0], q[1]));
+		return true;
+	}
+	const MultiControlledInstruction* ca = dynamic_cast<const MultiControlledInstruction*>(&a);
+	const MultiControlledInstruction* cb = dynamic_cast<const MultiControlledInstruction*>(&b);
+	if (ca != nullptr && cb != nullptr) {
+		if (ca->target() != cb->target()) return false;
+		product.reset(new MultiControlledInstruction(cb->controls(), cb->target(), g));
+		return true;
+	}
+	if (dynamic_cast<const UnitaryInstruction*>(&a) != nullptr && dynamic_cast<const UnitaryInstruction*>(&b) != nullptr) {
+		product.reset(new UnitaryInstruction(q, m));
+		return true;
+	}
+	return false;
+}
+
+//earlier instructions sharing qubits that cancel looks past for one to merge with
+static const unsigned int peephole_window = 16;
+
+size_t Routine::cancel() {
+	size_t count = instructions.size();
+
+	//instructions kept so far in order (null once removed), and the indices of those acting on each qubit
+	vector<unique_ptr<Instruction>> kept;
+	vector<vector<size_t>> uses(size_);
+
+	//latest kept instruction before index before acting on one of qubits q, false if there is none
+	auto previous = [&](const vector<unsigned int>& q, size_t before, size_t& latest) {
+		bool found = false;
+		for (unsigned int i : q) {
+			auto u = lower_bound(uses[i].begin(), uses[i].end(), before);
+			while (u != uses[i].begin()) {
+				if (kept[*--u] == nullptr) continue;
+				if (!found || *u > latest) latest = *u;
+				found = true;
+				break;
+			}
+		}
+		return found;
+	};
+
+	for (unique_ptr<Instruction>& it : instructions) {
+		vector<unsigned int> q = it->qubits();
+
+		//it moves back past the instructions it commutes with, and merges with the first it can. the product
+		//takes the place of the earlier one and moves on in turn.
+		size_t slot = kept.size();
+		size_t before = slot;
+		size_t p = 0;
+		for (unsigned int looked = 0; it != nullptr && looked < peephole_window && previous(q, before, p); looked++) {
+			unique_ptr<Instruction> product;
+			if (merge(*kept[p], *it, product)) {
+				kept[p].reset();
+				it = move(product);
+				slot = before = p;
+				looked = 0;
+			}
+			else if (commute(*kept[p], *it)) before = p;
+			else break;
+		}
+
+		if (it == nullptr) continue;
+		if (slot < kept.size()) {
+			kept[slot] = move(it);
+			continue;
+		}
+		for (unsigned int i : q) uses[i].push_back(kept.size());
+		kept.push_back(move(it));
+	}
+
+	instructions.clear();
+	for (unique_ptr<Instruction>& it : kept) if (it != nullptr) instructions.push_back(move(it));
+	return count - instructions.size();
+}
+
+size_t Routine::optimize(size_t* cancelled) {
+	//fused unitaries are rarely Clifford gates, and a stabilizer registry gains nothing from them
+	size_t removed = cancel();
+	if (cancelled != nullptr) *cancelled = removed;
+	if (fusion_width > 1 && !(Registry::stabilizer && clifford())) removed += fuse(fusion_width);
+	optimized_ = true;
+	scheduled_local_ = 0;
+	return removed;
+}
+
+bool Routine::unitary() const {
+	for (const unique_ptr<Instruction>& i : instructions) if (!i->unitary()) return false;
+	return true;
+}
+
+bool Routine::measuring() const {
+	for (const unique_ptr<Instruction>& i : instructions) {
+		if (dynamic_cast<const MeasureInstruction*>(i.get()) != nullptr) return true;
+	}
+	return false;
+}
+
+bool Routine::noisy() const {
+	for (const unique_ptr<Instruction>& i : instructions) {
+		if (dynamic_cast<const ChannelInstruction*>(i.get()) != nullptr) return true;
+	}
+	return false;
+}
+
+bool Routine::clifford() const {
+	for (const unique_ptr<Instruction>& i : instructions) {
+		if (dynamic_cast<const MeasureInstruction*>(i.get()) != nullptr) continue;
+		if (!i->unitary()) return false;
+		unsigned int k = (unsigned int)i->qubits().size();
+		if (k > Registry::max_unitary_qubits) return false;
+		vector<complex<double>> m((size_t)1 << (2 * k));
+		i->matrix(m.data());
+		if (!::clifford(m.data(), k)) return false;
+	}
+	return true;
+}
+
+vector<vector<unique_ptr<Instruction>>> Routine::plan(unsigned int local, bool remap) const {
+	vector<vector<unique_ptr<Instruction>>> steps;
+	vector<const Instruction*> list;
+	for (const unique_ptr<Instruction>& it : instructions) list.push_back(it.get());
+
+	//uses[q] holds the indices of the instructions acting on qubit q
+	vector<vector<size_t>> uses(size_);
+	for (size_t j = 0; j < list.size(); j++) {
+		for (unsigned int q : list[j]->qubits()) uses[q].push_back(j);
+	}
+	auto next_use = [&](unsigned int q, size_t from) {
+		auto u = lower_bound(uses[q].begin(), uses[q].end(), from);
+		return (u == uses[q].end()) ? SIZE_MAX : *u;
+	};
+
+	//map[q] is the qubit of the registry holding qubit q of the routine, held[p] the routine qubit held by p
+	vector<unsigned int> map(size_), held(size_);
+	for (unsigned int q = 0; q < size_; q++) map[q] = held[q] = q;
+
+	vector<unique_ptr<Instruction>> run;
+	auto flush = [&]() {
+		if (!run.empty()) steps.push_back(move(run));
+		run.clear();
+	};
+	auto single = [&](unique_ptr<Instruction> it) {
+		flush();
+		steps.emplace_back();
+		steps.back().push_back(move(it));
+	};
+	//exchanges the qubits of the registry in pairs, in one pass
+	auto exchange = [&](const vector<pair<unsigned int, unsigned int>>& pairs) {
+		single(unique_ptr<Instruction>(new SwapInstruction(pairs)));
+		for (const pair<unsigned int, unsigned int>& p : pairs) {
+			swap(held[p.first], held[p.second]);
+			map[held[p.first]] = p.first;
+			map[held[p.second]] = p.second;
+		}
+	};
+	auto is_local = [&](const vector<unsigned int>& q) {
+		for (unsigned int i : q) if (map[i] >= local) return false;
+		return true;
+	};
+
+	for (size_t j = 0; j < list.size(); j++) {
+		vector<unsigned int> q = list[j]->qubits();
+		bool fits = list[j]->unitary() && q.size() <= local;
+
+		if (remap && fits && !is_local(q)) {
+			//the following instructions whose qubits fit together in the local qubits form a stage
+			vector<unsigned int> stage;
+			size_t end = j;
+			for (; end < list.size() && list[end]->unitary(); end++) {
+				vector<unsigned int> u = stage;
+				for (unsigned int i : list[end]->qubits()) if (find(u.begin(), u.end(), i) == u.end()) u.push_back(i);
+				if (u.size() > local) break;
+				stage = u;
 			}
-			else {
-				new_rstate[i + (int)pow(2, q)] += rstate[i] * gate.transform().state0()->state1();
-				new_rstate[i] += rstate[i] * gate.transform().state0()->state0();
+
+			//qubits of the stage above local take the places of local qubits outside the stage used last
+			vector<unsigned int> slots;
+			for (unsigned int p = 0; p < min(local, size_); p++) {
+				if (find(stage.begin(), stage.end(), held[p]) == stage.end()) slots.push_back(p);
 			}
+			sort(slots.begin(), slots.end(), [&](unsigned int p0, unsigned int p1) {
+				return next_use(held[p0], end) > next_use(held[p1], end);
+			});
+
+			vector<pair<unsigned int, unsigned int>> pairs;
+			for (unsigned int i : stage) {
+				if (map[i] >= local) pairs.emplace_back(slots[pairs.size()], map[i]);
+			}
+			exchange(pairs);
+		}
+
+		if (fits && is_local(q)) run.push_back(list[j]->remapped(map));
+		else single(list[j]->remapped(map));
+	}
+
+	//qubits are swapped back to their own places, in rounds of disjoint swaps
+	while (true) {
+		vector<pair<unsigned int, unsigned int>> pairs;
+		vector<bool> used(size_, false);
+		for (unsigned int q = 0; q < size_; q++) {
+			if (map[q] == q || used[q] || used[map[q]]) continue;
+			used[q] = used[map[q]] = true;
+			pairs.emplace_back(q, map[q]);
 		}
+		if (pairs.empty()) break;
+		exchange(pairs);
 	}
+	flush();
+
+	return steps;
+}
 
-	delete[] rstate;
-	registry.registry = new_rstate;
+void Routine::schedule(unsigned int local) {
+	//each step is a pass over the registry, where a pass of swaps (gathering amplitudes from far apart) costs
+	//about as much as 3 passes of gates. swaps only pay off if gates on the swapped qubits join enough runs.
+	auto cost = [](const vector<vector<unique_ptr<Instruction>>>& steps) {
+		size_t passes = 0;
+		for (const vector<unique_ptr<Instruction>>& step : steps) {
+			passes += (step.size() == 1 && dynamic_cast<const SwapInstruction*>(step[0].get())) ? 3 : 1;
+		}
+		return passes;
+	};
+	schedule_ = plan(local, false);
+	vector<vector<unique_ptr<Instruction>>> remapped = plan(local, true);
+	if (cost(remapped) < cost(schedule_)) schedule_ = move(remapped);
+	scheduled_local_ = local;
 }
 
-void Routine::operator()(QRegistry& registry) {
+void Routine::operator()(Registry& registry) {
 	if (registry.size() < size_) throw size_exception(registry.size());
 
-	for (std::list<Instruction*>::iterator i = instructions.begin(); i != instructions.end(); i++) {
-		(**i)(registry);
+	if (!optimized_) optimize();
+
+	unsigned int local = registry.local_qubits();
+	if (local == 0 || registry.size() <= local || size_ <= 1) {
+		for (const unique_ptr<Instruction>& i : instructions) (*i)(registry);
+		return;
+	}
+
+	if (scheduled_local_ != local) schedule(local);
+	for (const vector<unique_ptr<Instruction>>& step : schedule_) {
+		if (step.size() == 1) (*step[0])(registry);
+		else registry.apply_local(step, local);
 	}
 }
 
-int QRegistry::measure_all() {
-	double random = ((double) rand()) / ((double) RAND_MAX);
-	//cout << random << endl;
-	double p = 0;
+//applies 2^K x 2^K matrix m to the groups of amplitudes of K qubits in [begin, end) groups. sorted are the qubits in
+//increasing order and offset[j] is the index of the amplitude with local index j relative to its group's base index.
+//the dimension being known at compile time, the loops over the group unroll and its amplitudes stay in registers.
+template<unsigned int K, typename T, typename V>
+static void apply_groups(V v, size_t begin, size_t end, const unsigned int* sorted, const size_t* offset, const complex<T>* m) {
+	const size_t dim = (size_t)1 << K;
+	T mr[dim * dim], mi[dim * dim];
+	for (size_t j = 0; j < dim * dim; j++) {
+		mr[j] = m[j].real();
+		mi[j] = m[j].imag();
+	}
 
-	int val = 0;
+	for (size_t g = begin; g < end; g++) {
+		size_t base = g;
+		for (unsigned int i = 0; i < K; i++) base = insert_zero(base, sorted[i]);
 
-	for (int i = 0; i < pow(2, this->size()); i++) {
-		//cout << registry[i] << endl;
-		
-		p += norm(registry[i]);
-		if (p >= random) {
-			val = i;
-			break;
+		T re[dim], im[dim];
+		for (size_t j = 0; j < dim; j++) {
+			complex<T> a = v.get(base + offset[j]);
+			re[j] = a.real();
+			im[j] = a.imag();
 		}
+		for (size_t r = 0; r < dim; r++) {
+			//real arithmetic avoids the inf/nan recovery of complex multiplication
+			T sr = 0, si = 0;
+			for (size_t c = 0; c < dim; c++) {
+				sr += mr[r * dim + c] * re[c] - mi[r * dim + c] * im[c];
+				si += mr[r * dim + c] * im[c] + mi[r * dim + c] * re[c];
+			}
+			v.set(base + offset[r], complex<T>(sr, si));
+		}
+	}
+}
+
+template<typename T>
+void BasicQRegistry<T>::apply_unitary(const vector<unsigned int>& qubits, const complex<double>* md) {
+	if (qubits.size() == 1) {
+		apply(qubits[0], md);
+		return;
 	}
+	if (qubits.size() > max_unitary_qubits) throw runtime_error("error: unitary on too many qubits");
+
+	unsigned int k = (unsigned int)qubits.size();
+	size_t dim = (size_t)1 << k;
+	vector<complex<T>> m(md, md + dim * dim);
+
+	//offset[j] is the index of the amplitude with local index j (bit i of j being qubit qubits[i]) relative to
+	//the group's base index, which has all k qubits 0. bases are group numbers with 0s inserted at sorted qubits.
+	size_t offset[(size_t)1 << max_unitary_qubits] = {};
+	for (size_t j = 0; j < dim; j++) {
+		for (unsigned int i = 0; i < k; i++) if ((j >> i) & 1) offset[j] |= (size_t)1 << qubits[i];
+	}
+	vector<unsigned int> sorted(qubits);
+	sort(sorted.begin(), sorted.end());
+
+	view([&](auto v) {
+		parallel_for(length() >> k, [&](size_t begin, size_t end) {
+			const unsigned int* s = sorted.data();
+			switch (k) {
+			case 2: apply_groups<2, T>(v, begin, end, s, offset, m.data()); break;
+			case 3: apply_groups<3, T>(v, begin, end, s, offset, m.data()); break;
+			case 4: apply_groups<4, T>(v, begin, end, s, offset, m.data()); break;
+			case 5: apply_groups<5, T>(v, begin, end, s, offset, m.data()); break;
+			default: apply_groups<6, T>(v, begin, end, s, offset, m.data());
+			}
+		});
+	});
+}
 
-	for (int i = 0; i < pow(2, this->size()); i++) {
-		if (i == val) registry[i] = 1;
-		else registry[i] = 0;
+template<typename T>
+void BasicQRegistry<T>::swap_qubits(const vector<pair<unsigned int, unsigned int>>& pairs) {
+	//the permutation of indices exchanging bits of disjoint pairs is its own inverse, so each amplitude is
+	//exchanged with the one at the permuted index, once
+	vector<unsigned int> perm(size_);
+	for (unsigned int q = 0; q < size_; q++) perm[q] = q;
+	bool identity = true;
+	for (const pair<unsigned int, unsigned int>& p : pairs) {
+		if (p.first == p.second) continue;
+		swap(perm[p.first], perm[p.second]);
+		identity = false;
 	}
+	if (identity) return;
+
+	//bits move independently, so the permuted index is the permuted low half of the index or'ed with the
+	//permuted high half, each looked up in a table
+	unsigned int low = (size_ + 1) / 2;
+	auto table = [&perm](unsigned int first, unsigned int count) {
+		vector<size_t> t((size_t)1 << count, 0);
+		for (unsigned int q = 0; q < count; q++) {
+			size_t bit = (size_t)1 << perm[first + q];
+			for (size_t k = 0; k < ((size_t)1 << q); k++) t[k | ((size_t)1 << q)] = t[k] | bit;
+		}
+		return t;
+	};
+	vector<size_t> low_table = table(0, low);
+	vector<size_t> high_table = table(low, size_ - low);
+
+	view([&](auto v) {
+		parallel_for(high_table.size(), [&](size_t begin, size_t end) {
+			for (size_t h = begin; h < end; h++) {
+				size_t base = h << low;
+				for (size_t l = 0; l < low_table.size(); l++) {
+					size_t i = base | l;
+					size_t j = high_table[h] | low_table[l];
+					if (i < j) {
+						complex<T> x = v.get(i);
+						v.set(i, v.get(j));
+						v.set(j, x);
+					}
+				}
+			}
+		}, low_table.size());
+	});
+}
+
+template<typename T>
+unsigned int BasicQRegistry<T>::local_qubits() const {
+	unsigned int local = 0;
+	while (((size_t)2 << local) * sizeof(complex<T>) <= cache_size) local++;
+	return local;
+}
+
+template<typename T>
+void BasicQRegistry<T>::apply_local(const vector<unique_ptr<Instruction>>& instructions, unsigned int local) {
+	size_t chunk = (size_t)1 << local;
+	T* re = reinterpret_cast<T*>(registry);
+	T* im = imag_;
+	Layout layout = layout_;
+
+	//each chunk is a registry of the local qubits, and gates within a chunk run on a single thread
+	parallel_for(length() >> local, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; c++) {
+			complex<T>* amplitudes = (layout == Layout::split) ? reinterpret_cast<complex<T>*>(re + c * chunk) : registry + c * chunk;
+			BasicQRegistry<T> part(local, layout, amplitudes, (layout == Layout::split) ? im + c * chunk : nullptr);
+			for (const unique_ptr<Instruction>& i : instructions) (*i)(part);
+		}
+	}, chunk);
+}
+
+template<typename T>
+double BasicQRegistry<T>::total() const {
+	return view([this](auto v) {
+		return parallel_sum(length(), [v](size_t begin, size_t end) {
+			double p = 0;
+			for (size_t k = begin; k < end; k++) p += v.norm(k);
+			return p;
+		});
+	});
+}
+
+template<typename T>
+double BasicQRegistry<T>::probability(unsigned int i) const {
+	size_t mask = (size_t)1 << i;
+
+	//summed over the states with bit i set
+	return view([this, i, mask](auto v) {
+		return parallel_sum(length() / 2, [v, i, mask](size_t begin, size_t end) {
+			double p = 0;
+			for (size_t k = begin; k < end; k++) p += v.norm(insert_zero(k, i) | mask);
+			return p;
+		});
+	});
+}
+
+template<typename T>
+double BasicQRegistry<T>::pauli_expectation(uint64_t flip, uint64_t sign, unsigned int ys) const {
+	return view([this, flip, sign, ys](auto v) {
+		return parallel_sum(length(), [v, flip, sign, ys](size_t begin, size_t end) {
+			double sum = 0;
+			for (size_t k = begin; k < end; k++) sum += pauli_term(k, sign, ys, complex<double>(v.get(k)), complex<double>(v.get(k ^ flip)));
+			return sum;
+		});
+	});
+}
+
+template<typename T>
+void BasicQRegistry<T>::reduced(unsigned int i, complex<double>* rho) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+	size_t mask = (size_t)1 << i;
+
+	//sums of |a0|^2, |a1|^2 and a0 conj(a1) over the pairs of states differing in bit i
+	double sum[4] = { 0, 0, 0, 0 };
+	mutex m;
+	view([this, i, mask, &sum, &m](auto v) {
+		parallel_for(length() / 2, [v, i, mask, &sum, &m](size_t begin, size_t end) {
+			double partial[4] = { 0, 0, 0, 0 };
+			for (size_t k = begin; k < end; k++) {
+				size_t i0 = insert_zero(k, i);
+				complex<T> a0 = v.get(i0), a1 = v.get(i0 | mask);
+				complex<T> c = a0 * conj(a1);
+				partial[0] += std::norm(a0);
+				partial[1] += std::norm(a1);
+				partial[2] += c.real();
+				partial[3] += c.imag();
+			}
+			lock_guard<mutex> lock(m);
+			for (int j = 0; j < 4; j++) sum[j] += partial[j];
+		});
+	});
+
+	rho[0] = sum[0];
+	rho[1] = complex<double>(sum[2], sum[3]);
+	rho[2] = complex<double>(sum[2], -sum[3]);
+	rho[3] = sum[1];
+}
+
+template<typename T>
+void BasicQRegistry<T>::collapse(unsigned int i, bool value, double p) {
+	size_t mask = (size_t)1 << i;
+
+	//zero the states with the other value and renormalize the remaining ones, in the same pass
+	T scale = (T)(1 / sqrt(p));
+	size_t keep = value ? mask : 0;
+	view([this, i, mask, keep, scale](auto v) {
+		parallel_for(length() / 2, [v, i, mask, keep, scale](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; k++) {
+				size_t i0 = insert_zero(k, i);
+				v.scale(i0 | keep, scale);
+				v.set((i0 | mask) ^ keep, 0);
+			}
+		});
+	});
+}
+
+template<typename T>
+bool BasicQRegistry<T>::measure(unsigned int i) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+
+	double p1 = probability(i);
+	bool value = p1 >= 1 || rng::local().uniform() < p1;
+	collapse(i, value, value ? p1 : 1 - p1);
 
-	return val;
+	return value;
 }
+
+//states per block of the cumulative distribution used for sampling
+static const size_t cdf_block = 4096;
+
+template<typename T>
+vector<double> BasicQRegistry<T>::cdf() const {
+	size_t pw = length();
+	size_t blocks = (pw + cdf_block - 1) / cdf_block;
+
+	//block sums in parallel, then a serial prefix sum over the (few) blocks
+	vector<double> cdf(blocks);
+	view([&](auto v) {
+		parallel_for(blocks, [&](size_t begin, size_t end) {
+			for (size_t b = begin; b < end; b++) {
+				double p = 0;
+				for (size_t i = b * cdf_block; i < min(pw, (b + 1) * cdf_block); i++) p += v.norm(i);
+				cdf[b] = p;
+			}
+		}, cdf_block);
+	});
+	partial_sum(cdf.begin(), cdf.end(), cdf.begin());
+
+	return cdf;
+}
+
+template<typename T>
+map<uint64_t, size_t> BasicQRegistry<T>::sample(size_t shots) const {
+	rng::generator& generator = rng::local();
+	vector<double> u(shots);
+	for (double& r : u) r = generator.uniform();
+	sort(u.begin(), u.end());
+
+	return sample(u);
+}
+
+template<typename T>
+map<uint64_t, size_t> BasicQRegistry<T>::sample(const vector<double>& u) const {
+	size_t pw = length();
+	vector<double> cdf = this->cdf();
+
+	vector<double> random(u.size());
+	for (size_t j = 0; j < u.size(); j++) random[j] = u[j] * cdf.back();
+
+	//sorted samples are found in a single sweep: binary search of block in cdf, then scan within block
+	map<uint64_t, size_t> counts;
+	view([&](auto v) {
+		size_t b = 0;
+		size_t i = 0;
+		double p = 0; //probability of values below i
+		for (double r : random) {
+			size_t next = upper_bound(cdf.begin() + b, cdf.end() - 1, r) - cdf.begin();
+			if (next != b) {
+				b = next;
+				i = b * cdf_block;
+				p = (b == 0) ? 0 : cdf[b - 1];
+			}
+
+			while (i + 1 < min(pw, (b + 1) * cdf_block) && p + v.norm(i) <= r) p += v.norm(i++);
+			counts[i]++;
+		}
+	});
+
+	return counts;
+}
+
+template<typename T>
+uint64_t BasicQRegistry<T>::measure_all() {
+	return measure_all(rng::local().uniform());
+}
+
+template<typename T>
+uint64_t BasicQRegistry<T>::measure_all(double u) {
+	size_t pw = length();
+	vector<double> cdf = this->cdf();
+
+	return view([&](auto v) {
+		//binary search of block in cdf, then scan within block
+		double r = u * cdf.back();
+		size_t b = upper_bound(cdf.begin(), cdf.end() - 1, r) - cdf.begin();
+		double p = (b == 0) ? 0 : cdf[b - 1];
+		uint64_t val = b * cdf_block;
+		while (val + 1 < min(pw, (b + 1) * cdf_block) && p + v.norm(val) <= r) p += v.norm(val++);
+
+		//collapse to val. blocks of probability 0 are already zero, so only blocks with some probability are cleared.
+		parallel_for(cdf.size(), [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++) {
+				if (cdf[c] == ((c == 0) ? 0 : cdf[c - 1])) continue;
+				v.zero(c * cdf_block, min(pw, (c + 1) * cdf_block));
+			}
+		}, cdf_block);
+		v.set(val, 1);
+
+		return val;
+	});
+}
+
+//index of selected state j, inserting zeros at the bits of mask (in increasing order) and setting value
+static inline size_t selected_state(size_t j, const vector<unsigned int>& bits, size_t value) {
+	for (unsigned int b : bits) j = insert_zero(j, b);
+	return j | value;
+}
+
+static vector<unsigned int> mask_bits(size_t mask) {
+	vector<unsigned int> bits;
+	for (unsigned int b = 0; mask >> b != 0; b++) if ((mask >> b) & 1) bits.push_back(b);
+	return bits;
+}
+
+template<typename T>
+void BasicQRegistry<T>::export_amplitudes(size_t mask, size_t value, size_t first, size_t count, complex<T>* out) const {
+	vector<unsigned int> bits = mask_bits(mask);
+	view([&](auto v) {
+		parallel_for(count, [&](size_t begin, size_t end) {
+			for (size_t j = begin; j < end; j++) out[j] = v.get(selected_state(first + j, bits, value));
+		});
+	});
+}
+
+template<typename T>
+void BasicQRegistry<T>::import_amplitudes(size_t mask, size_t value, size_t first, size_t count, const complex<T>* in) {
+	vector<unsigned int> bits = mask_bits(mask);
+	view([&](auto v) {
+		parallel_for(count, [&](size_t begin, size_t end) {
+			for (size_t j = begin; j < end; j++) v.set(selected_state(first + j, bits, value), in[j]);
+		});
+	});
+}
+
+template<typename T>
+void BasicQRegistry<T>::combine(size_t mask, size_t value, size_t first, size_t count, const complex<T>* other,
+	complex<double> a, complex<double> b) {
+	vector<unsigned int> bits = mask_bits(mask);
+	complex<T> ca(a), cb(b);
+	bool mix = (b != 0.0);
+	view([&](auto v) {
+		parallel_for(count, [&](size_t begin, size_t end) {
+			for (size_t j = begin; j < end; j++) {
+				size_t i = selected_state(first + j, bits, value);
+				v.set(i, mix ? ca * v.get(i) + cb * other[j] : ca * v.get(i));
+			}
+		});
+	});
+}
+
+template<typename T>
+void BasicQRegistry<T>::assign(const vector<pair<uint64_t, complex<T>>>& amplitudes) {
+	view([&](auto v) {
+		parallel_for(length(), [v](size_t begin, size_t end) { v.zero(begin, end); });
+		for (const pair<uint64_t, complex<T>>& a : amplitudes) v.set((size_t)a.first, a.second);
+	});
+}
+
+template class BasicQRegistry<double>;
+
+template class BasicQRegistry<float>;
@@ -3,64 +3,106 @@
 #include <cmath>
 #include <utility>
 #include <list>
+#include <map>
+#include <memory>
+#include <vector>
+#include <algorithm>
 #include <string>
 #include <iostream>
+#include <cstdint>
+#include <stdexcept>
 
-class Qubit;
+template<typename T> class BasicQubit;
 
-class Gate;
+typedef BasicQubit<double> Qubit;
 
-class CGate;
+template<typename T> class BasicGate;
+
+typedef BasicGate<double> Gate;
+
+template<typename T> class BasicCGate;
+
+typedef BasicCGate<double> CGate;
 
 class Instruction;
 
 class GateInstruction;
 
+class CGateInstruction;
+
+class UnitaryInstruction;
+
+class MeasureInstruction;
+
+class SwapInstruction;
+
 class Routine;
 
-class QRegistry;
+class Registry;
 
+template<typename T> class BasicQRegistry;
 
+typedef BasicQRegistry<double> QRegistry;
 
+typedef BasicQRegistry<float> QRegistryF;
 
 
-class Qubit {
+
+
+
+//a qubit in state state0 |0> + state1 |1>, with amplitudes of type std::complex<T>
+template<typename T>
+class BasicQubit {
 private:
-	std::complex<double> state0_;
+	std::complex<T> state0_;
 
-	std::complex<double> state1_;
+	std::complex<T> state1_;
 
 public:
-	Qubit(std::complex<double> state0, std::complex<double> state1) {
-		double abs = std::sqrt(std::norm(state0) + std::norm(state1));
+	BasicQubit(std::complex<T> state0, std::complex<T> state1) {
+		T abs = std::sqrt(std::norm(state0) + std::norm(state1));
 		state0_ = state0 / abs;
 		state1_ = state1 / abs;
 	}
 
-	friend Qubit&& operator+ (const Qubit& q1, const Qubit& q2) {
-		std::complex<double> state0 = q1.state0() + q2.state0();
-		std::complex<double> state1 = q1.state1() + q2.state1();
-		return Qubit(state0, state1);
+	friend BasicQubit&& operator+ (const BasicQubit& q1, const BasicQubit& q2) {
+		std::complex<T> state0 = q1.state0() + q2.state0();
+		std::complex<T> state1 = q1.state1() + q2.state1();
+		return BasicQubit(state0, state1);
 	}
 
-	static std::complex<double> inner_product(const Qubit& q1, const Qubit& q2) {
+	static std::complex<T> inner_product(const BasicQubit& q1, const BasicQubit& q2) {
 		return (q1.state0() * q2.state0()) + (q1.state1() * q2.state1());
 	}
 
-	std::complex<double> state0() const { return state0_; }
+	std::complex<T> state0() const { return state0_; }
 
-	std::complex<double> state1() const { return state1_; }
+	std::complex<T> state1() const { return state1_; }
 };
 
 
 
+//structure of a 2x2 gate matrix, letting kernels skip multiplications by 0 (and by 1):
+//diagonal gates (Rz, Ph, T, ...) only change phases, antidiagonal gates (not) permute amplitudes
+enum class GateKind { general, diagonal, antidiagonal };
+
+//classifies 2x2 matrix m (row-major)
+GateKind classify(const std::complex<double>* m);
+
+//storage of the amplitudes of a state vector: interleaved (real, imaginary) pairs as std::complex, or an array of
+//real parts followed by an array of imaginary parts, which vector instructions process without shuffles
+enum class Layout { interleaved, split };
+
+
+
 //represents a 1-qubit gate applying a unitary operation to a target qubit:
 //takes a qubit in state 0 to state state0, qubit in state 1 to state state1
-class Gate {
+template<typename T>
+class BasicGate {
 private:
-	const Qubit* state0_;
+	const BasicQubit<T>* state0_;
 
-	const Qubit* state1_;
+	const BasicQubit<T>* state1_;
 
 public:
 	class unitary_exception : public std::exception {
@@ -69,25 +111,34 @@ public:
 	};
 
 
-	Gate(const Qubit& state0, const Qubit& state1) : state0_(&state0), state1_(&state1) {
-		//if (Qubit::inner_product(*state0_, *state1_) != 0.0) throw unitary_exception();
+	BasicGate(const BasicQubit<T>& state0, const BasicQubit<T>& state1) : state0_(&state0), state1_(&state1) {
+		//if (BasicQubit<T>::inner_product(*state0_, *state1_) != T(0)) throw unitary_exception();
 	}
 	
-	const Qubit* state0() const { return state0_; }
-	const Qubit* state1() const { return state1_; }
+	const BasicQubit<T>* state0() const { return state0_; }
+	const BasicQubit<T>* state1() const { return state1_; }
+
+	//writes the 2x2 matrix of the gate to m in row-major order (m[0] = <0|U|0>, m[1] = <0|U|1>, ...)
+	void matrix(std::complex<T>* m) const {
+		m[0] = state0_->state0();
+		m[1] = state1_->state0();
+		m[2] = state0_->state1();
+		m[3] = state1_->state1();
+	}
 	
 };
 
 //represents a 2-qubit gate applying a certain unitary transformation to a target qubit,
 //conditioned by a control qubit being in a certain state ctrl (thus entangling both qubits)
-class CGate {
+template<typename T>
+class BasicCGate {
 private:
-	Gate transform_;
+	BasicGate<T> transform_;
 
 public:
-	CGate(const Gate& transform) : transform_(transform) {}
+	BasicCGate(const BasicGate<T>& transform) : transform_(transform) {}
 
-	const Gate& transform() const {
+	const BasicGate<T>& transform() const {
 		return transform_;
 	}
 };
@@ -105,41 +156,212 @@ private:
 public:
 	virtual ~Instruction() = default;
 
-	virtual void operator()(QRegistry& registry) const = 0;
+	virtual void operator()(Registry& registry) const = 0;
 
 	virtual unsigned int size() const = 0;
+
+	//qubits acted upon by instruction: qubits()[j] is bit j of the row and column indices of matrix()
+	virtual std::vector<unsigned int> qubits() const = 0;
+
+	//writes unitary applied by instruction to its qubits, a 2^k x 2^k matrix in row-major order.
+	//only valid for unitary instructions.
+	virtual void matrix(std::complex<double>* m) const = 0;
+
+	//false for instructions that are not a unitary operation (measurements)
+	virtual bool unitary() const { return true; }
+
+	//copy of instruction acting on qubit map[q] wherever it acts on qubit q
+	virtual std::unique_ptr<Instruction> remapped(const std::vector<unsigned int>& map) const = 0;
 };
 
 class GateInstruction : public Instruction {
 private:
-	const Gate gate_;
+	std::complex<double> matrix_[4];
 	unsigned int target_;
 
 public:
-	GateInstruction(const Gate& gate, unsigned int target) : gate_(gate), target_(target) {}
+	GateInstruction(const Gate& gate, unsigned int target) : target_(target) { gate.matrix(matrix_); }
+
+	//instruction applying 2x2 matrix m (row-major) to target
+	GateInstruction(const std::complex<double>* m, unsigned int target) : target_(target) { std::copy(m, m + 4, matrix_); }
 
-	void operator()(QRegistry& registry) const override;
+	void operator()(Registry& registry) const override;
 
 	unsigned int size() const override { return target_; }
+
+	std::vector<unsigned int> qubits() const override { return { target_ }; }
+
+	void matrix(std::complex<double>* m) const override { std::copy(matrix_, matrix_ + 4, m); }
+
+	std::unique_ptr<Instruction> remapped(const std::vector<unsigned int>& map) const override {
+		return std::unique_ptr<Instruction>(new GateInstruction(matrix_, map[target_]));
+	}
 };
 
 class CGateInstruction : public Instruction {
 private:
-	const CGate gate_;
+	std::complex<double> matrix_[4];
 	unsigned int control_;
 	unsigned int target_;
 
 public:
-	CGateInstruction(const CGate& gate, unsigned int control, unsigned int target) : gate_(gate), control_(control), target_(target) {}
+	CGateInstruction(const CGate& gate, unsigned int control, unsigned int target) : control_(control), target_(target) {
+		gate.transform().matrix(matrix_);
+	}
+
+	//instruction applying 2x2 matrix m (row-major) to target, conditioned by control
+	CGateInstruction(const std::complex<double>* m, unsigned int control, unsigned int target) : control_(control), target_(target) {
+		std::copy(m, m + 4, matrix_);
+	}
+
+	//2x2 matrix applied to target (row-major)
+	const std::complex<double>* gate() const { return matrix_; }
 
-	void operator()(QRegistry& registry) const override;
+	void operator()(Registry& registry) const override;
 
 	unsigned int size() const override {
 		if (target_ > control_) return target_;
 		return control_;
 	}
+
+	std::vector<unsigned int> qubits() const override { return { control_, target_ }; }
+
+	void matrix(std::complex<double>* m) const override;
+
+	std::unique_ptr<Instruction> remapped(const std::vector<unsigned int>& map) const override {
+		return std::unique_ptr<Instruction>(new CGateInstruction(matrix_, map[control_], map[target_]));
+	}
 };
 
+//an instruction applying a 2x2 matrix to a target qubit in the states where all of several control qubits are 1,
+//e.g. a Toffoli gate (not with 2 controls), in a single pass over a registry
+class MultiControlledInstruction : public Instruction {
+private:
+	std::complex<double> matrix_[4];
+	std::vector<unsigned int> controls_;
+	unsigned int target_;
+
+public:
+	//instruction applying 2x2 matrix m (row-major) to target, conditioned by all of controls
+	MultiControlledInstruction(const std::vector<unsigned int>& controls, unsigned int target, const std::complex<double>* m)
+		: controls_(controls), target_(target) {
+		std::copy(m, m + 4, matrix_);
+	}
+
+	const std::vector<unsigned int>& controls() const { return controls_; }
+
+	unsigned int target() const { return target_; }
+
+	//2x2 matrix applied to target (row-major)
+	const std::complex<double>* gate() const { return matrix_; }
+
+	void operator()(Registry& registry) const override;
+
+	unsigned int size() const override;
+
+	//the controls, then the target
+	std::vector<unsigned int> qubits() const override;
+
+	void matrix(std::complex<double>* m) const override;
+
+	std::unique_ptr<Instruction> remapped(const std::vector<unsigned int>& map) const override;
+};
+
+//an instruction applying a dense unitary to k qubits, e.g. several gates fused together
+class UnitaryInstruction : public Instruction {
+private:
+	std::vector<unsigned int> qubits_;
+	std::vector<std::complex<double>> matrix_;
+
+public:
+	//qubits[j] is bit j of the row and column indices of matrix, a 2^k x 2^k matrix in row-major order
+	UnitaryInstruction(const std::vector<unsigned int>& qubits, const std::vector<std::complex<double>>& matrix)
+		: qubits_(qubits), matrix_(matrix) {}
+
+	void operator()(Registry& registry) const override;
+
+	unsigned int size() const override;
+
+	std::vector<unsigned int> qubits() const override { return qubits_; }
+
+	void matrix(std::complex<double>* m) const override { std::copy(matrix_.begin(), matrix_.end(), m); }
+
+	std::unique_ptr<Instruction> remapped(const std::vector<unsigned int>& map) const override;
+};
+
+//an instruction exchanging the states of pairs of qubits (disjoint pairs), in a single pass over a registry
+class SwapInstruction : public Instruction {
+private:
+	std::vector<std::pair<unsigned int, unsigned int>> pairs_;
+
+public:
+	SwapInstruction(const std::vector<std::pair<unsigned int, unsigned int>>& pairs) : pairs_(pairs) {}
+
+	SwapInstruction(unsigned int a, unsigned int b) : pairs_({ { a, b } }) {}
+
+	void operator()(Registry& registry) const override;
+
+	unsigned int size() const override;
+
+	//the qubits of pair j are qubits()[2j] and qubits()[2j + 1]
+	std::vector<unsigned int> qubits() const override;
+
+	void matrix(std::complex<double>* m) const override;
+
+	std::unique_ptr<Instruction> remapped(const std::vector<unsigned int>& map) const override;
+};
+
+//an instruction measuring a single qubit, collapsing the registry to the measured value
+class MeasureInstruction : public Instruction {
+private:
+	unsigned int target_;
+
+public:
+	//print each measured value
+	static bool verbose;
+
+	MeasureInstruction(unsigned int target) : target_(target) {}
+
+	void operator()(Registry& registry) const override;
+
+	unsigned int size() const override { return target_; }
+
+	std::vector<unsigned int> qubits() const override { return { target_ }; }
+
+	void matrix(std::complex<double>*) const override { throw std::logic_error("measurement is not unitary"); }
+
+	bool unitary() const override { return false; }
+
+	std::unique_ptr<Instruction> remapped(const std::vector<unsigned int>& map) const override {
+		return std::unique_ptr<Instruction>(new MeasureInstruction(map[target_]));
+	}
+};
+
+//an instruction applying a noise channel to a qubit, given by 2x2 Kraus operators (row-major, concatenated)
+class ChannelInstruction : public Instruction {
+private:
+	unsigned int target_;
+	std::vector<std::complex<double>> kraus_;
+
+public:
+	ChannelInstruction(unsigned int target, const std::vector<std::complex<double>>& kraus) : target_(target), kraus_(kraus) {}
+
+	const std::vector<std::complex<double>>& kraus() const { return kraus_; }
+
+	void operator()(Registry& registry) const override;
+
+	unsigned int size() const override { return target_; }
+
+	std::vector<unsigned int> qubits() const override { return { target_ }; }
+
+	void matrix(std::complex<double>*) const override { throw std::logic_error("noise channel is not unitary"); }
+
+	bool unitary() const override { return false; }
+
+	std::unique_ptr<Instruction> remapped(const std::vector<unsigned int>& map) const override {
+		return std::unique_ptr<Instruction>(new ChannelInstruction(map[target_], kraus_));
+	}
+};
 
 //a sequence of instructions for a quantum registry of a given size
 class Routine {
@@ -147,69 +369,362 @@ private:
 	//size of registry
 	unsigned int size_;
 
-	std::list<Instruction*> instructions;
+	std::list<std::unique_ptr<Instruction>> instructions;
+
+	//instructions were already optimized
+	bool optimized_;
+
+	//instructions in the order applied to registries of more than local qubits: runs of instructions on local
+	//qubits applied together chunk by chunk (steps of more than one instruction), and single instructions.
+	//qubits are remapped by swaps so that gates on other qubits join runs, and mapped back in the end.
+	std::vector<std::vector<std::unique_ptr<Instruction>>> schedule_;
+
+	//local qubits of schedule_, 0 if not scheduled
+	unsigned int scheduled_local_;
+
+	//steps applying instructions to registries of more than local qubits, with qubits remapped by swaps or not
+	std::vector<std::vector<std::unique_ptr<Instruction>>> plan(unsigned int local, bool remap) const;
+
+	//sets schedule_ to the plan of fewer steps
+	void schedule(unsigned int local);
 
 public:
-	Routine(int size) : size_(size) { instructions = std::list<Instruction*>(); }
+	//widest unitary the fusion pass ahead of operator() may create (1 or less disables fusion)
+	static unsigned int fusion_width;
+
+	Routine(int size) : size_(size), optimized_(false), scheduled_local_(0) {}
+
+	unsigned int size() const { return size_; }
 
 	class size_exception : public std::exception {
 	private:
-		unsigned int size_;
+		std::string what_;
 
 	public:
-		size_exception(unsigned int size) : size_(size) {}
+		size_exception(unsigned int size) : what_("registry size exception: size of registry " + std::to_string(size) + " qubits") {}
 
-		virtual const char* what() const override {
-			std::string str("registry size exception: size of registry ");
-			str += std::to_string(size_);
-			str += " qubits";
-			return str.c_str();
-		}
+		virtual const char* what() const override { return what_.c_str(); }
 	};
 	
-	//adds an instruction to the end of routine.
-	//throws size_exception if instruction requires too large size.
+	//adds an instruction to the end of routine, which takes ownership of it.
+	//throws runtime_error if instruction requires too large size, as applying it to a registry would.
 	//throws bad_alloc if failed to allocate memory for instruction.
 	void append(Instruction* it) {
-		if (it->size() > size_) throw size_exception(size_);
-		instructions.push_back(it);
+		std::unique_ptr<Instruction> owned(it);
+		if (it->size() >= size_) throw std::runtime_error("registry not large enough");
+		instructions.push_back(std::move(owned));
+		optimized_ = false;
 	}
 
-	void operator()(QRegistry& registry);
+	size_t length() const { return instructions.size(); }
+
+	//calls f(i) for each instruction i in order
+	template<typename F>
+	void for_each(const F& f) const {
+		for (const std::unique_ptr<Instruction>& i : instructions) f(*i);
+	}
+
+	//marks instructions as optimized already (e.g. loaded from a compiled circuit), so operator() applies them as they are
+	void mark_optimized() {
+		optimized_ = true;
+		scheduled_local_ = 0;
+	}
+
+	//true if all instructions are unitary (no measurements)
+	bool unitary() const;
+
+	//true if routine measures qubits along the way
+	bool measuring() const;
+
+	//true if routine applies noise channels
+	bool noisy() const;
+
+	//true if all unitary instructions are Clifford gates and the others measurements, so that the routine runs on
+	//a StabilizerRegistry
+	bool clifford() const;
+
+	//merges runs of consecutive instructions acting together on at most max_width qubits into single unitaries,
+	//so that each run costs one pass over the registry. returns number of instructions removed.
+	size_t fuse(unsigned int max_width);
+
+	//peephole pass: merges each gate with an earlier one of the same kind on the same qubits (e.g. rotations about
+	//the same axis add up) and removes both if they cancel out (e.g. H H, T Tdag), looking past the instructions
+	//in between that it commutes with (those on other qubits, and e.g. diagonal gates on the control of a
+	//controlled gate). returns number of instructions removed.
+	size_t cancel();
+
+	//cancels and fuses instructions. returns number of instructions removed, and sets cancelled (if not null) to the
+	//number of those removed by cancel.
+	size_t optimize(size_t* cancelled = nullptr);
+
+	//optimizes instructions (unless already optimized) and applies them to registry. if the registry is larger
+	//than its local_qubits, runs of instructions on local qubits are applied to one cache-sized chunk of the
+	//registry after another.
+	void operator()(Registry& registry);
 };
 
-class QRegistry {
-private:
+//state of a registry of qubits, acted upon by instructions. instructions give their matrices in double precision,
+//whatever the representation of the state.
+class Registry {
+protected:
 	unsigned int size_;
 
-	std::complex<double>* registry;
-
-	void display() const { for (int i = 0; i < (int)std::pow(2, size_); i++) std::cout << registry[i] << std::endl; }
+	//largest state vector (in bytes) a registry may allocate
+	static size_t memory_budget_;
 
 public:
-	QRegistry(unsigned int size) {
-		size_ = size;
-		registry = new std::complex<double>[(int)std::pow(2, size)];
-		registry[0] = 1;
-		for (int i = 1; i < std::pow(2, size); i++) registry[i] = 0;
+	class memory_exception : public std::exception {
+	private:
+		std::string what_;
+
+	public:
+		memory_exception(unsigned int size, size_t budget) {
+			what_ = "error: state vector of " + std::to_string(size) + " qubits does not fit in memory budget of "
+				+ std::to_string(budget >> 20) + " MiB";
+		}
+
+		const char* what() const override { return what_.c_str(); }
+	};
+
+	//registries made by create use single precision amplitudes (QRegistryF) instead of double (QRegistry)
+	static bool single_precision;
+
+	//layout of the amplitudes of registries made by create
+	static Layout layout;
+
+	//fraction of the states that may be nonzero before a registry made by create switches from holding only those
+	//(SparseRegistry) to the whole state vector, 0 to make dense registries only
+	static double sparse_fill;
+
+	//registries made by create hold density matrices (DensityRegistry), applying noise channels exactly
+	static bool density;
+
+	//largest bond dimension of the matrix product states (MpsRegistry) made by create, 0 to make none
+	static unsigned int mps_bond;
+
+	//largest weight of the singular values a matrix product state drops together, beyond those over mps_bond
+	static double mps_truncation;
+
+	//size (in bytes) of the chunks of state vectors that several gates are applied to in a row (about the size of
+	//the l2 cache), 0 to apply each gate to the whole state vector
+	static size_t cache_size;
+
+	Registry(unsigned int size) : size_(size) {}
+
+	virtual ~Registry() = default;
+
+	//registries made by create for Clifford routines are StabilizerRegistry
+	static bool stabilizer;
+
+	//constructs registry of given size in state |0...0>, of the precision and layout selected by single_precision
+	//and layout. the registry is split over the ranks of the cluster if there are several, else sparse unless
+	//sparse_fill is 0. if only Clifford gates are going to be applied (clifford), the registry is a
+	//StabilizerRegistry unless stabilizer is false, and otherwise a DensityRegistry if density is set or an
+	//MpsRegistry if mps_bond is not 0.
+	//throws memory_exception if state vector exceeds memory budget, bad_alloc if allocation fails.
+	static Registry* create(unsigned int size, bool clifford = false);
+
+	unsigned int size() const { return size_; }
+
+	static size_t memory_budget() { return memory_budget_; }
+
+	static void set_memory_budget(size_t bytes) { memory_budget_ = bytes; }
+
+	//sets registry to state |0...0>
+	virtual void reset() = 0;
+
+	//amplitude of state i
+	virtual std::complex<double> amplitude(size_t i) const = 0;
+
+	//measures value of particular qubit (true for 1, false for 0), collapsing the registry to the states
+	//with that value
+	virtual bool measure(unsigned int i) = 0;
+
+	//measures value of entire registry (qubits are binary representation of number)
+	virtual uint64_t measure_all() = 0;
+
+	//measures value of entire registry shots times without collapsing it, as if it were prepared again for each shot.
+	//returns number of times each value was measured.
+	virtual std::map<uint64_t, size_t> sample(size_t shots) const = 0;
+
+	//measure_all and sample with values given as strings of the bits of qubits size - 1 down to 0, for registries
+	//of more than 64 qubits
+	virtual std::string measure_bits();
+
+	virtual std::map<std::string, size_t> sample_bits(size_t shots) const;
+
+	//applies 2x2 matrix m (row-major) to target qubit in place
+	virtual void apply(unsigned int target, const std::complex<double>* m) = 0;
+
+	//applies 2x2 matrix m (row-major) to target qubit in place, for states where control qubit is 1
+	virtual void apply_controlled(unsigned int control, unsigned int target, const std::complex<double>* m) = 0;
+
+	//applies 2x2 matrix m (row-major) to target qubit in place, for states where all control qubits are 1 (distinct,
+	//other than target). unless overridden, applied by apply, apply_controlled or as a dense unitary by apply_unitary
+	//(throwing runtime_error beyond max_unitary_qubits qubits).
+	virtual void apply_multi_controlled(const std::vector<unsigned int>& controls, unsigned int target, const std::complex<double>* m);
+
+	//applies the noise channel of 2x2 Kraus operators kraus (row-major, concatenated) to target qubit. a pure state
+	//is replaced by the outcome of one operator, drawn with its probability, so that runs average to the channel
+	//(Monte-Carlo trajectories). throws runtime_error if the registry cannot compute the probabilities (reduced).
+	virtual void apply_channel(unsigned int target, const std::vector<std::complex<double>>& kraus);
+
+	//writes the 2x2 reduced density matrix (row-major) of qubit i to rho.
+	//throws runtime_error if the registry does not support noise channels.
+	virtual void reduced(unsigned int i, std::complex<double>* rho);
+
+	//expectation value of the Pauli product that flips the qubits set in flip (those of X and Y), negates the states
+	//with an odd number of the qubits set in sign (those of Y and Z) and has ys factors Y (each contributing i).
+	//throws runtime_error if the registry does not support expectation values.
+	virtual double pauli_expectation(uint64_t flip, uint64_t sign, unsigned int ys) const;
+
+	//true if the registry holds a mixed state, to which noise channels are applied exactly
+	virtual bool mixed() const { return false; }
+
+	//widest unitary apply_unitary accepts
+	static const unsigned int max_unitary_qubits = 6;
+
+	//applies 2^k x 2^k matrix m (row-major) to k distinct qubits in place, qubits[j] being bit j of the indices of m
+	virtual void apply_unitary(const std::vector<unsigned int>& qubits, const std::complex<double>* m) = 0;
+
+	//exchanges the states of the qubits of each pair (disjoint pairs)
+	virtual void swap_qubits(const std::vector<std::pair<unsigned int, unsigned int>>& pairs);
+
+	//number of low qubits whose amplitudes fit in cache_size, 0 if instructions are not applied by chunks
+	virtual unsigned int local_qubits() const { return 0; }
+
+	//applies unitary instructions acting on qubits below local in order
+	virtual void apply_local(const std::vector<std::unique_ptr<Instruction>>& instructions, unsigned int) {
+		for (const std::unique_ptr<Instruction>& i : instructions) (*i)(*this);
+	}
+
+protected:
+	//term of state i of a Pauli expectation (see pauli_expectation): the real part of
+	//i^ys (-1)^(bits of i in sign) conj(b) a, for amplitudes a of state i and b of state i ^ flip
+	static double pauli_term(uint64_t i, uint64_t sign, unsigned int ys, std::complex<double> a, std::complex<double> b) {
+		std::complex<double> t = std::conj(b) * a;
+		double v = (ys & 1) ? -t.imag() : t.real();
+		if (ys & 2) v = -v;
+
+		//parity of the bits of i in sign
+		uint64_t odd = i & sign;
+		for (unsigned int shift = 32; shift > 0; shift >>= 1) odd ^= odd >> shift;
+		return (odd & 1) ? -v : v;
 	}
 
-	QRegistry(QRegistry&& registry) noexcept {
+	//Kraus operator of kraus (see apply_channel) whose outcome falls at u (uniform in [0, 1)) in the probabilities
+	//of the outcomes of a qubit of reduced density matrix rho, scaled to keep the norm of the state
+	static std::vector<std::complex<double>> draw_kraus(const std::vector<std::complex<double>>& kraus,
+		const std::complex<double>* rho, double u);
+};
+
+//state vector of 2^size amplitudes of type std::complex<T>. float halves the memory and bandwidth of double,
+//at the cost of precision (about 7 significant digits per amplitude).
+template<typename T>
+class BasicQRegistry : public Registry {
+private:
+	//2^size amplitudes. in split layout, 2^size real parts (imaginary parts are in imag_).
+	std::complex<T>* registry;
+
+	T* imag_;
+
+	Layout layout_;
+
+	//registry owns its amplitudes, rather than being a chunk of another registry
+	bool owner_;
+
+	//registry of the amplitudes of a chunk of another registry (not owned)
+	BasicQRegistry(unsigned int size, Layout layout, std::complex<T>* amplitudes, T* imag)
+		: Registry(size), registry(amplitudes), imag_(imag), layout_(layout), owner_(false) {}
+
+	//calls f with a view of the amplitudes in the layout of registry, and returns its result
+	template<typename F>
+	auto view(const F& f) const;
+
+	//cdf[b] is probability of the states below (b + 1) * 4096, computed in parallel
+	std::vector<double> cdf() const;
+
+	void display() const { for (size_t i = 0; i < length(); i++) std::cout << amplitude(i) << std::endl; }
+
+public:
+	//constructs registry of given size in state |0...0>, with amplitudes stored in given layout.
+	//throws memory_exception if state vector exceeds memory budget, bad_alloc if allocation fails.
+	BasicQRegistry(unsigned int size, Layout layout = Layout::interleaved);
+
+	BasicQRegistry(BasicQRegistry&& registry) noexcept
+		: Registry(registry.size()), imag_(registry.imag_), layout_(registry.layout()), owner_(registry.owner_) {
 		this->registry = registry.registry;
-		size_ = registry.size();
+		registry.registry = nullptr;
 	}
 
-	~QRegistry() { delete[] registry; }
+	~BasicQRegistry();
 
-	unsigned int size() const { return size_;  }
+	//number of amplitudes in state vector (2^size)
+	size_t length() const { return (size_t)1 << size_; }
 
-	//measures value of particular qubit (true for 1, false for 0)
-	bool measure(int i);
+	Layout layout() const { return layout_; }
 
-	//measures value of entire registry (qubits are binary representation of number)
-	int measure_all();
+	void reset() override;
+
+	std::complex<double> amplitude(size_t i) const override;
+
+	bool measure(unsigned int i) override;
+
+	uint64_t measure_all() override;
+
+	std::map<uint64_t, size_t> sample(size_t shots) const override;
+
+	void apply(unsigned int target, const std::complex<double>* m) override;
+
+	void apply_controlled(unsigned int control, unsigned int target, const std::complex<double>* m) override;
+
+	void apply_multi_controlled(const std::vector<unsigned int>& controls, unsigned int target, const std::complex<double>* m) override;
+
+	void apply_unitary(const std::vector<unsigned int>& qubits, const std::complex<double>* m) override;
+
+	void swap_qubits(const std::vector<std::pair<unsigned int, unsigned int>>& pairs) override;
+
+	void reduced(unsigned int i, std::complex<double>* rho) override;
+
+	//summed over the amplitudes in parallel
+	double pauli_expectation(uint64_t flip, uint64_t sign, unsigned int ys) const override;
+
+	unsigned int local_qubits() const override;
+
+	//applies instructions chunk by chunk, chunks in parallel
+	void apply_local(const std::vector<std::unique_ptr<Instruction>>& instructions, unsigned int local) override;
+
+	//the following are the parts of the operations above that a distributed registry (holding a part of a state
+	//vector in each process) combines with the other parts
+
+	//sum of probabilities of all states, 1 unless registry is a part of a larger one
+	double total() const;
+
+	//probability of qubit i being 1, summed over all states
+	double probability(unsigned int i) const;
+
+	//zeroes the states where qubit i is not value, and multiplies the others by 1 / sqrt(p)
+	void collapse(unsigned int i, bool value, double p);
+
+	//measure_all with u uniform in [0, 1) given rather than drawn
+	uint64_t measure_all(double u);
+
+	//sample with sorted u uniform in [0, 1) given for each shot rather than drawn
+	std::map<uint64_t, size_t> sample(const std::vector<double>& u) const;
+
+	//the selected states are those with (i & mask) == value, numbered in increasing order of i
+
+	//copies amplitudes of selected states [first, first + count) to out
+	void export_amplitudes(size_t mask, size_t value, size_t first, size_t count, std::complex<T>* out) const;
+
+	//sets amplitudes of selected states [first, first + count) to in
+	void import_amplitudes(size_t mask, size_t value, size_t first, size_t count, const std::complex<T>* in);
 
-	friend void GateInstruction::operator()(QRegistry&) const;
+	//sets registry to the state with given amplitudes, all others being 0
+	void assign(const std::vector<std::pair<uint64_t, std::complex<T>>>& amplitudes);
 
-	friend void CGateInstruction::operator()(QRegistry&) const;
+	//sets amplitude x of each selected state in [first, first + count) to a x + b y, y being its amplitude in other
+	//(numbered from first). other is not read if b is 0.
+	void combine(size_t mask, size_t value, size_t first, size_t count, const std::complex<T>* other,
+		std::complex<double> a, std::complex<double> b);
 };
\ No newline at end of file
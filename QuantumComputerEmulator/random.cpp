@@ -0,0 +1,105 @@
+#include "random.h"
+#include <atomic>
+
+using namespace std;
+
+//splitmix64, used to expand a seed into generator state
+static uint64_t splitmix(uint64_t& x) {
+	uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+rng::xoshiro256::xoshiro256(uint64_t seed, uint64_t stream) {
+	uint64_t x = seed ^ splitmix(stream);
+	for (uint64_t& s : s_) s = splitmix(x);
+}
+
+uint64_t rng::xoshiro256::next() {
+	uint64_t result = rotl(s_[1] * 5, 7) * 9;
+	uint64_t t = s_[1] << 17;
+	s_[2] ^= s_[0];
+	s_[3] ^= s_[1];
+	s_[1] ^= s_[2];
+	s_[0] ^= s_[3];
+	s_[2] ^= t;
+	s_[3] = rotl(s_[3], 45);
+	return result;
+}
+
+rng::pcg32::pcg32(uint64_t seed, uint64_t stream) : state_(0), inc_((stream << 1) | 1) {
+	next32();
+	state_ += seed;
+	next32();
+}
+
+uint32_t rng::pcg32::next32() {
+	uint64_t old = state_;
+	state_ = old * 6364136223846793005ULL + inc_;
+	uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+	uint32_t rot = (uint32_t)(old >> 59);
+	return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+}
+
+uint64_t rng::pcg32::next() {
+	uint64_t high = next32();
+	return (high << 32) | next32();
+}
+
+static uint64_t global_seed = 0;
+
+static rng::algorithm global_algorithm = rng::algorithm::xoshiro256;
+
+//incremented when seed or algorithm change, invalidating the generators of all threads
+static atomic<unsigned int> epoch(0);
+
+//streams handed out to threads since last change
+static atomic<uint64_t> streams(0);
+
+rng::generator::generator(uint64_t seed, uint64_t stream) : algorithm_(global_algorithm), xoshiro_(seed, stream), pcg_(seed, stream) {}
+
+void rng::seed(uint64_t seed) {
+	global_seed = seed;
+	streams = 0;
+	epoch++;
+}
+
+uint64_t rng::seed() {
+	return global_seed;
+}
+
+bool rng::select(const string& name) {
+	if (name.compare("xoshiro256") == 0) global_algorithm = algorithm::xoshiro256;
+	else if (name.compare("pcg32") == 0) global_algorithm = algorithm::pcg32;
+	else return false;
+
+	streams = 0;
+	epoch++;
+	return true;
+}
+
+rng::algorithm rng::selected() {
+	return global_algorithm;
+}
+
+//generator of each thread, and the epoch it was made in
+static thread_local rng::generator local_generator(0, 0);
+static thread_local unsigned int local_epoch = ~0u;
+
+rng::generator& rng::local() {
+	if (local_epoch != epoch) {
+		local_generator = generator(global_seed, streams++);
+		local_epoch = epoch;
+	}
+	return local_generator;
+}
+
+void rng::restart(uint64_t stream) {
+	local_generator = generator(global_seed, stream);
+	local_epoch = epoch;
+}
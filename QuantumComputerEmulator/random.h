@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+//seedable random number generators. every thread draws from its own stream of the global seed,
+//so measurements are reproducible from the seed and threads never contend for a generator.
+namespace rng {
+	//xoshiro256** (Blackman & Vigna): 256 bits of state, fast and statistically strong
+	class xoshiro256 {
+	private:
+		uint64_t s_[4];
+
+	public:
+		xoshiro256(uint64_t seed, uint64_t stream);
+
+		uint64_t next();
+	};
+
+	//pcg32 (O'Neill): 64 bits of state, 32 bit outputs (two per number)
+	class pcg32 {
+	private:
+		uint64_t state_;
+		uint64_t inc_;
+
+		uint32_t next32();
+
+	public:
+		pcg32(uint64_t seed, uint64_t stream);
+
+		uint64_t next();
+	};
+
+	enum class algorithm { xoshiro256, pcg32 };
+
+	//a generator of the algorithm selected when it was constructed
+	class generator {
+	private:
+		algorithm algorithm_;
+		xoshiro256 xoshiro_;
+		pcg32 pcg_;
+
+	public:
+		//generator for given stream of seed; different streams are independent
+		generator(uint64_t seed, uint64_t stream);
+
+		uint64_t next() { return algorithm_ == algorithm::xoshiro256 ? xoshiro_.next() : pcg_.next(); }
+
+		//uniform double in [0, 1), with 53 random bits
+		double uniform() { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); }
+	};
+
+	//sets the global seed and restarts all streams
+	void seed(uint64_t seed);
+
+	uint64_t seed();
+
+	//selects algorithm by name (xoshiro256 or pcg32) and restarts all streams. returns false if name is unknown.
+	bool select(const std::string& name);
+
+	algorithm selected();
+
+	//generator of the calling thread: the main thread draws from stream 0, other threads from the following
+	//streams in the order they first draw
+	generator& local();
+
+	//restarts the generator of the calling thread at given stream of the global seed, so that what it draws next
+	//does not depend on which thread draws it (e.g. in tasks run by whichever thread is free)
+	void restart(uint64_t stream);
+}
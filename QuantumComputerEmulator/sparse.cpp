@@ -0,0 +1,278 @@
+#include "sparse.h"
+#include "random.h"
+#include <complex>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <new>
+
+using namespace std;
+
+template<typename T>
+SparseRegistry<T>::SparseRegistry(unsigned int size, Layout layout) : Registry(size), layout_(layout) {
+	if (size > 64) throw runtime_error("error: registries have at most 64 qubits");
+	amplitudes_[0] = 1;
+}
+
+template<typename T>
+void SparseRegistry<T>::densify() {
+	if (dense_ || (double)amplitudes_.size() <= ldexp(sparse_fill, size_)) return;
+
+	//a state vector beyond the memory budget is never made, the registry stays sparse
+	if (size_ >= sizeof(size_t) * 8 - 4 || (sizeof(complex<T>) << size_) > memory_budget_) return;
+	try {
+		dense_.reset(new BasicQRegistry<T>(size_, layout_));
+	}
+	catch (bad_alloc) {
+		return;
+	}
+
+	dense_->assign(vector<pair<uint64_t, complex<T>>>(amplitudes_.begin(), amplitudes_.end()));
+	unordered_map<uint64_t, complex<T>>().swap(amplitudes_);
+}
+
+template<typename T>
+void SparseRegistry<T>::add(unordered_map<uint64_t, complex<T>>& amplitudes, uint64_t i, complex<T> a) {
+	if (a == complex<T>(0)) return;
+	auto found = amplitudes.emplace(i, a);
+	if (!found.second) found.first->second += a;
+}
+
+template<typename T>
+void SparseRegistry<T>::replace(unordered_map<uint64_t, complex<T>>& amplitudes) {
+	//amplitudes cancelling up to rounding (as of H applied twice) leave residues far below any probability
+	const T tiny = numeric_limits<T>::epsilon() * numeric_limits<T>::epsilon();
+	for (auto it = amplitudes.begin(); it != amplitudes.end();) {
+		if (norm(it->second) < tiny) it = amplitudes.erase(it);
+		else it++;
+	}
+	amplitudes_.swap(amplitudes);
+}
+
+template<typename T>
+vector<pair<uint64_t, double>> SparseRegistry<T>::cdf() const {
+	vector<pair<uint64_t, double>> cdf;
+	cdf.reserve(amplitudes_.size());
+	for (const pair<const uint64_t, complex<T>>& a : amplitudes_) cdf.emplace_back(a.first, norm(a.second));
+	sort(cdf.begin(), cdf.end());
+	for (size_t j = 1; j < cdf.size(); j++) cdf[j].second += cdf[j - 1].second;
+	return cdf;
+}
+
+template<typename T>
+void SparseRegistry<T>::reset() {
+	dense_.reset();
+	amplitudes_.clear();
+	amplitudes_[0] = 1;
+}
+
+template<typename T>
+complex<double> SparseRegistry<T>::amplitude(size_t i) const {
+	if (dense_) return dense_->amplitude(i);
+
+	auto found = amplitudes_.find(i);
+	return (found == amplitudes_.end()) ? 0 : complex<double>(found->second);
+}
+
+template<typename T>
+bool SparseRegistry<T>::measure(unsigned int i) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+	if (dense_) return dense_->measure(i);
+
+	uint64_t mask = (uint64_t)1 << i;
+	double p1 = 0;
+	for (const pair<const uint64_t, complex<T>>& a : amplitudes_) if (a.first & mask) p1 += norm(a.second);
+
+	bool value = p1 >= 1 || rng::local().uniform() < p1;
+
+	//drop the states with the other value and renormalize the remaining ones
+	T scale = (T)(1 / sqrt(value ? p1 : 1 - p1));
+	for (auto it = amplitudes_.begin(); it != amplitudes_.end();) {
+		if (((it->first & mask) != 0) != value) it = amplitudes_.erase(it);
+		else (it++)->second *= scale;
+	}
+
+	return value;
+}
+
+template<typename T>
+uint64_t SparseRegistry<T>::measure_all() {
+	if (dense_) return dense_->measure_all();
+
+	vector<pair<uint64_t, double>> cdf = this->cdf();
+	double r = rng::local().uniform() * cdf.back().second;
+	auto found = upper_bound(cdf.begin(), cdf.end() - 1, r, [](double x, const pair<uint64_t, double>& c) { return x < c.second; });
+	uint64_t val = found->first;
+
+	amplitudes_.clear();
+	amplitudes_[val] = 1;
+	return val;
+}
+
+template<typename T>
+map<uint64_t, size_t> SparseRegistry<T>::sample(size_t shots) const {
+	if (dense_) return dense_->sample(shots);
+
+	vector<pair<uint64_t, double>> cdf = this->cdf();
+
+	rng::generator& generator = rng::local();
+	vector<double> random(shots);
+	for (double& r : random) r = generator.uniform() * cdf.back().second;
+	sort(random.begin(), random.end());
+
+	//sorted samples are found in a single sweep of the cdf
+	map<uint64_t, size_t> counts;
+	size_t j = 0;
+	for (double r : random) {
+		while (j + 1 < cdf.size() && cdf[j].second <= r) j++;
+		counts[cdf[j].first]++;
+	}
+
+	return counts;
+}
+
+template<typename T>
+void SparseRegistry<T>::apply(unsigned int target, const complex<double>* m) {
+	if (dense_) return dense_->apply(target, m);
+	apply_masked(0, target, m);
+}
+
+template<typename T>
+void SparseRegistry<T>::apply_controlled(unsigned int control, unsigned int target, const complex<double>* m) {
+	if (dense_) return dense_->apply_controlled(control, target, m);
+	apply_masked((uint64_t)1 << control, target, m);
+}
+
+template<typename T>
+void SparseRegistry<T>::apply_multi_controlled(const vector<unsigned int>& controls, unsigned int target, const complex<double>* m) {
+	if (dense_) return dense_->apply_multi_controlled(controls, target, m);
+
+	uint64_t cmask = 0;
+	for (unsigned int c : controls) cmask |= (uint64_t)1 << c;
+	apply_masked(cmask, target, m);
+}
+
+template<typename T>
+void SparseRegistry<T>::apply_masked(uint64_t cmask, unsigned int target, const complex<double>* m) {
+	uint64_t mask = (uint64_t)1 << target;
+	complex<T> c[4] = { complex<T>(m[0]), complex<T>(m[1]), complex<T>(m[2]), complex<T>(m[3]) };
+
+	//diagonal gates scale amplitudes in place, and never add states
+	if (m[1] == 0.0 && m[2] == 0.0) {
+		unordered_map<uint64_t, complex<T>> amplitudes;
+		amplitudes.reserve(amplitudes_.size());
+		for (const pair<const uint64_t, complex<T>>& a : amplitudes_) {
+			if ((a.first & cmask) != cmask) amplitudes.emplace(a.first, a.second);
+			else add(amplitudes, a.first, c[(a.first & mask) ? 3 : 0] * a.second);
+		}
+		replace(amplitudes);
+		return;
+	}
+
+	//state i contributes column (bit of i) of m to both states of its pair
+	unordered_map<uint64_t, complex<T>> amplitudes;
+	amplitudes.reserve(2 * amplitudes_.size());
+	for (const pair<const uint64_t, complex<T>>& a : amplitudes_) {
+		if ((a.first & cmask) != cmask) {
+			add(amplitudes, a.first, a.second);
+			continue;
+		}
+		int b = (a.first & mask) ? 1 : 0;
+		add(amplitudes, a.first & ~mask, c[b] * a.second);
+		add(amplitudes, a.first | mask, c[2 + b] * a.second);
+	}
+	replace(amplitudes);
+	densify();
+}
+
+template<typename T>
+void SparseRegistry<T>::apply_unitary(const vector<unsigned int>& qubits, const complex<double>* m) {
+	if (dense_) return dense_->apply_unitary(qubits, m);
+	if (qubits.size() > max_unitary_qubits) throw runtime_error("error: unitary on too many qubits");
+
+	size_t k = qubits.size();
+	size_t dim = (size_t)1 << k;
+	vector<complex<T>> mt(m, m + dim * dim);
+
+	//offset[j] holds the bits of qubits set in local index j
+	vector<uint64_t> offset(dim, 0);
+	uint64_t mask = 0;
+	for (size_t j = 0; j < dim; j++) {
+		for (size_t i = 0; i < k; i++) if ((j >> i) & 1) offset[j] |= (uint64_t)1 << qubits[i];
+	}
+	for (unsigned int q : qubits) mask |= (uint64_t)1 << q;
+
+	unordered_map<uint64_t, complex<T>> amplitudes;
+	amplitudes.reserve(amplitudes_.size());
+	for (const pair<const uint64_t, complex<T>>& a : amplitudes_) {
+		size_t col = 0;
+		for (size_t i = 0; i < k; i++) if ((a.first >> qubits[i]) & 1) col |= (size_t)1 << i;
+		uint64_t base = a.first & ~mask;
+		for (size_t r = 0; r < dim; r++) add(amplitudes, base | offset[r], mt[r * dim + col] * a.second);
+	}
+	replace(amplitudes);
+	densify();
+}
+
+template<typename T>
+void SparseRegistry<T>::swap_qubits(const vector<pair<unsigned int, unsigned int>>& pairs) {
+	if (dense_) return dense_->swap_qubits(pairs);
+
+	//states whose bits of a pair differ move to the state with both bits flipped
+	unordered_map<uint64_t, complex<T>> amplitudes;
+	amplitudes.reserve(amplitudes_.size());
+	for (const pair<const uint64_t, complex<T>>& a : amplitudes_) {
+		uint64_t i = a.first;
+		for (const pair<unsigned int, unsigned int>& p : pairs) {
+			uint64_t mask = ((uint64_t)1 << p.first) | ((uint64_t)1 << p.second);
+			uint64_t bits = a.first & mask;
+			if (bits != 0 && bits != mask) i ^= mask;
+		}
+		amplitudes.emplace(i, a.second);
+	}
+	amplitudes_.swap(amplitudes);
+}
+
+template<typename T>
+void SparseRegistry<T>::reduced(unsigned int i, complex<double>* rho) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+	if (dense_) return dense_->reduced(i, rho);
+
+	//the off-diagonal element pairs each state having bit i clear with the state having it set, if held
+	uint64_t mask = (uint64_t)1 << i;
+	fill(rho, rho + 4, complex<double>(0));
+	for (const pair<const uint64_t, complex<T>>& a : amplitudes_) {
+		if (a.first & mask) {
+			rho[3] += norm(a.second);
+			continue;
+		}
+		rho[0] += norm(a.second);
+		auto partner = amplitudes_.find(a.first | mask);
+		if (partner != amplitudes_.end()) rho[1] += complex<double>(a.second * conj(partner->second));
+	}
+	rho[2] = conj(rho[1]);
+}
+
+template<typename T>
+double SparseRegistry<T>::pauli_expectation(uint64_t flip, uint64_t sign, unsigned int ys) const {
+	if (dense_) return dense_->pauli_expectation(flip, sign, ys);
+
+	//a term vanishes unless both states it pairs are held
+	double sum = 0;
+	for (const pair<const uint64_t, complex<T>>& a : amplitudes_) {
+		auto partner = amplitudes_.find(a.first ^ flip);
+		if (partner != amplitudes_.end()) sum += pauli_term(a.first, sign, ys, complex<double>(a.second), complex<double>(partner->second));
+	}
+	return sum;
+}
+
+template<typename T>
+void SparseRegistry<T>::apply_local(const vector<unique_ptr<Instruction>>& instructions, unsigned int local) {
+	if (dense_) dense_->apply_local(instructions, local);
+	else Registry::apply_local(instructions, local);
+}
+
+template class SparseRegistry<double>;
+
+template class SparseRegistry<float>;
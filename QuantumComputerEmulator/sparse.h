@@ -0,0 +1,72 @@
+#pragma once
+#include "quantum.h"
+#include <unordered_map>
+
+//state vector holding only its nonzero amplitudes, in a hash map from state to amplitude, so that a gate costs time
+//proportional to their number rather than to 2^size. once more than sparse_fill of the states are nonzero, the
+//amplitudes move to a dense BasicQRegistry (of the layout selected by Registry::layout) that takes over all
+//operations, unless its state vector exceeds the memory budget.
+template<typename T>
+class SparseRegistry : public Registry {
+private:
+	std::unordered_map<uint64_t, std::complex<T>> amplitudes_;
+
+	//registry holding the amplitudes after the switch to dense, null before
+	std::unique_ptr<BasicQRegistry<T>> dense_;
+
+	Layout layout_;
+
+	//moves the amplitudes to dense_, if there are enough of them and the state vector fits
+	void densify();
+
+	//adds amplitude a to state i of amplitudes
+	static void add(std::unordered_map<uint64_t, std::complex<T>>& amplitudes, uint64_t i, std::complex<T> a);
+
+	//replaces amplitudes_ by amplitudes, without those too small to affect any probability
+	void replace(std::unordered_map<uint64_t, std::complex<T>>& amplitudes);
+
+	//applies 2x2 matrix m to target qubit in the states where all bits of cmask are 1
+	void apply_masked(uint64_t cmask, unsigned int target, const std::complex<double>* m);
+
+	//nonzero states sorted by index, with the cumulative probability up to each
+	std::vector<std::pair<uint64_t, double>> cdf() const;
+
+public:
+	//constructs registry of given size in state |0...0>, switching to given layout when dense
+	SparseRegistry(unsigned int size, Layout layout = Layout::interleaved);
+
+	//true once the amplitudes are held by a dense registry
+	bool dense() const { return dense_ != nullptr; }
+
+	//number of amplitudes held
+	size_t count() const { return dense_ ? dense_->length() : amplitudes_.size(); }
+
+	void reset() override;
+
+	std::complex<double> amplitude(size_t i) const override;
+
+	bool measure(unsigned int i) override;
+
+	uint64_t measure_all() override;
+
+	std::map<uint64_t, size_t> sample(size_t shots) const override;
+
+	void apply(unsigned int target, const std::complex<double>* m) override;
+
+	void apply_controlled(unsigned int control, unsigned int target, const std::complex<double>* m) override;
+
+	void apply_multi_controlled(const std::vector<unsigned int>& controls, unsigned int target, const std::complex<double>* m) override;
+
+	void apply_unitary(const std::vector<unsigned int>& qubits, const std::complex<double>* m) override;
+
+	void swap_qubits(const std::vector<std::pair<unsigned int, unsigned int>>& pairs) override;
+
+	void reduced(unsigned int i, std::complex<double>* rho) override;
+
+	//summed over the nonzero amplitudes only
+	double pauli_expectation(uint64_t flip, uint64_t sign, unsigned int ys) const override;
+
+	unsigned int local_qubits() const override { return dense_ ? dense_->local_qubits() : 0; }
+
+	void apply_local(const std::vector<std::unique_ptr<Instruction>>& instructions, unsigned int local) override;
+};
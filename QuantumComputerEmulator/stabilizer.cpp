@@ -0,0 +1,330 @@
+#include "stabilizer.h"
+#include "random.h"
+#include <complex>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+static inline int popcount(uint64_t x) {
+#ifdef _MSC_VER
+	return (int)__popcnt64(x);
+#else
+	return __builtin_popcountll(x);
+#endif
+}
+
+//entries of matrices recognized as Clifford gates may be off by this much (angles are given to about 8 digits)
+static const double tolerance = 1e-6;
+
+//a Pauli product on k qubits, i^e times the product over qubits j of X^(bit j of x) Z^(bit j of z)
+struct pauli {
+	unsigned int e;
+	uint64_t x;
+	uint64_t z;
+};
+
+//product p q: moving the Z factors of p past the X factors of q gives a sign for every qubit they share
+static pauli multiply(const pauli& p, const pauli& q) {
+	return { (p.e + q.e + 2 * (unsigned int)popcount(p.z & q.x)) & 3, p.x ^ q.x, p.z ^ q.z };
+}
+
+//finds p with m = p (as a matrix), given that m is 2^k x 2^k. returns false if there is none.
+static bool as_pauli(const vector<complex<double>>& m, unsigned int k, pauli& p) {
+	size_t dim = (size_t)1 << k;
+	static const complex<double> powers[4] = { 1, complex<double>(0, 1), -1, complex<double>(0, -1) };
+
+	//p |c> = i^e (-1)^(z.c) |c xor x>: column 0 gives x and e, column 2^j gives bit j of z
+	p.x = 0;
+	for (size_t r = 1; r < dim; r++) if (abs(m[r * dim]) > abs(m[p.x * dim])) p.x = r;
+	p.e = 4;
+	for (unsigned int e = 0; e < 4; e++) if (abs(m[p.x * dim] - powers[e]) < tolerance) p.e = e;
+	if (p.e == 4) return false;
+	p.z = 0;
+	for (unsigned int j = 0; j < k; j++) {
+		size_t c = (size_t)1 << j;
+		if (abs(m[(c ^ p.x) * dim + c] + powers[p.e]) < tolerance) p.z |= c;
+	}
+
+	for (size_t c = 0; c < dim; c++) {
+		complex<double> value = powers[p.e] * ((popcount(p.z & c) & 1) ? -1.0 : 1.0);
+		for (size_t r = 0; r < dim; r++) {
+			if (abs(m[r * dim + c] - ((r == (c ^ p.x)) ? value : 0.0)) > tolerance) return false;
+		}
+	}
+	return true;
+}
+
+//images[2j] and images[2j + 1] are m X_j m^dagger and m Z_j m^dagger. returns false if they are not all Pauli
+//products, i.e. m is not a Clifford gate.
+static bool images(const complex<double>* m, unsigned int k, vector<pauli>& images) {
+	size_t dim = (size_t)1 << k;
+	vector<complex<double>> mg(dim * dim), image(dim * dim);
+	images.resize(2 * k);
+
+	for (unsigned int j = 0; j < 2 * k; j++) {
+		size_t bit = (size_t)1 << (j / 2);
+		//m G, where X_j flips bit j of the column and Z_j negates the columns with bit j set
+		for (size_t r = 0; r < dim; r++) {
+			for (size_t c = 0; c < dim; c++) {
+				if (j % 2 == 0) mg[r * dim + c] = m[r * dim + (c ^ bit)];
+				else mg[r * dim + c] = (c & bit) ? -m[r * dim + c] : m[r * dim + c];
+			}
+		}
+		for (size_t r = 0; r < dim; r++) {
+			for (size_t c = 0; c < dim; c++) {
+				complex<double> sum = 0;
+				for (size_t s = 0; s < dim; s++) sum += mg[r * dim + s] * conj(m[c * dim + s]);
+				image[r * dim + c] = sum;
+			}
+		}
+		if (!as_pauli(image, k, images[j])) return false;
+	}
+	return true;
+}
+
+bool clifford(const complex<double>* m, unsigned int k) {
+	vector<pauli> p;
+	return images(m, k, p);
+}
+
+StabilizerRegistry::StabilizerRegistry(unsigned int size) : Registry(size), words_((size + 63) / 64) {
+	reset();
+}
+
+void StabilizerRegistry::reset() {
+	//destabilizer q is X_q, stabilizer q is Z_q
+	x_.assign((2 * (size_t)size_ + 1) * words_, 0);
+	z_.assign((2 * (size_t)size_ + 1) * words_, 0);
+	r_.assign(2 * (size_t)size_ + 1, 0);
+	for (unsigned int q = 0; q < size_; q++) {
+		x(q)[q >> 6] |= (uint64_t)1 << (q & 63);
+		z(size_ + q)[q >> 6] |= (uint64_t)1 << (q & 63);
+	}
+}
+
+void StabilizerRegistry::rowsum(size_t h, size_t i) {
+	//the exponent of i of the product is 2 r_h + 2 r_i plus, per qubit, +1 or -1 as the Paulis of row i and h
+	//come in cyclic order (X, Y, Z) or not
+	uint64_t* xh = x(h);
+	uint64_t* zh = z(h);
+	const uint64_t* xi = x(i);
+	const uint64_t* zi = z(i);
+
+	int sum = 2 * r_[h] + 2 * r_[i];
+	for (size_t w = 0; w < words_; w++) {
+		uint64_t x1 = xi[w], z1 = zi[w], x2 = xh[w], z2 = zh[w];
+		uint64_t y = x1 & z1, xo = x1 & ~z1, zo = ~x1 & z1;
+		uint64_t plus = (y & z2 & ~x2) | (xo & z2 & x2) | (zo & x2 & ~z2);
+		uint64_t minus = (y & x2 & ~z2) | (xo & z2 & ~x2) | (zo & x2 & z2);
+		sum += popcount(plus) - popcount(minus);
+		xh[w] = x2 ^ x1;
+		zh[w] = z2 ^ z1;
+	}
+	r_[h] = (((sum % 4) + 4) % 4 == 2) ? 1 : 0;
+}
+
+void StabilizerRegistry::copy_row(size_t to, size_t from) {
+	copy(x(from), x(from) + words_, x(to));
+	copy(z(from), z(from) + words_, z(to));
+	r_[to] = r_[from];
+}
+
+void StabilizerRegistry::conjugate(const vector<unsigned int>& qubits, const complex<double>* m) {
+	unsigned int k = (unsigned int)qubits.size();
+	vector<pauli> image;
+	if (!images(m, k, image)) throw runtime_error("error: stabilizer registries apply Clifford gates only");
+
+	for (size_t row = 0; row < 2 * (size_t)size_; row++) {
+		//part of the row on qubits, as i^e X^a Z^b with the sign of the row (Y = i X Z)
+		uint64_t a = 0, b = 0;
+		for (unsigned int j = 0; j < k; j++) {
+			if (x(row, qubits[j])) a |= (uint64_t)1 << j;
+			if (z(row, qubits[j])) b |= (uint64_t)1 << j;
+		}
+		if (a == 0 && b == 0) continue;
+
+		//m X^a Z^b m^dagger is the product of the images of its factors
+		pauli p = { (2 * r_[row] + (unsigned int)popcount(a & b)) & 3, 0, 0 };
+		for (unsigned int j = 0; j < k; j++) {
+			if ((a >> j) & 1) p = multiply(p, image[2 * j]);
+			if ((b >> j) & 1) p = multiply(p, image[2 * j + 1]);
+		}
+
+		//back to a sign and Paulis: the exponent left after taking out the Ys is even for a hermitian product
+		r_[row] = (unsigned char)(((p.e + 4 - (popcount(p.x & p.z) & 3)) & 3) / 2);
+		for (unsigned int j = 0; j < k; j++) {
+			unsigned int q = qubits[j];
+			uint64_t bit = (uint64_t)1 << (q & 63);
+			x(row)[q >> 6] = ((p.x >> j) & 1) ? (x(row)[q >> 6] | bit) : (x(row)[q >> 6] & ~bit);
+			z(row)[q >> 6] = ((p.z >> j) & 1) ? (z(row)[q >> 6] | bit) : (z(row)[q >> 6] & ~bit);
+		}
+	}
+}
+
+bool StabilizerRegistry::measure(unsigned int a, int outcome, bool& random) {
+	size_t n = size_;
+
+	//the value is random if a stabilizer anticommutes with Z_a (has X on a)
+	size_t p = n;
+	while (p < 2 * n && !x(p, a)) p++;
+	random = p < 2 * n;
+
+	if (random) {
+		for (size_t i = 0; i < 2 * n; i++) if (i != p && x(i, a)) rowsum(i, p);
+		copy_row(p - n, p);
+		fill(x(p), x(p) + words_, 0);
+		fill(z(p), z(p) + words_, 0);
+		z(p)[a >> 6] |= (uint64_t)1 << (a & 63);
+		r_[p] = (unsigned char)((outcome < 0) ? (rng::local().next() >> 63) : outcome);
+		return r_[p] != 0;
+	}
+
+	//the value is determined: the product of the stabilizers whose destabilizers have X on a is +-Z_a
+	size_t scratch = 2 * n;
+	fill(x(scratch), x(scratch) + words_, 0);
+	fill(z(scratch), z(scratch) + words_, 0);
+	r_[scratch] = 0;
+	for (size_t i = 0; i < n; i++) if (x(i, a)) rowsum(scratch, i + n);
+	return r_[scratch] != 0;
+}
+
+complex<double> StabilizerRegistry::amplitude(size_t i) const {
+	//measuring every qubit with the value of its bit in i halves the probability at each random value
+	StabilizerRegistry copy(*this);
+	double p = 1;
+	for (unsigned int q = 0; q < size_; q++) {
+		bool bit = q < 64 && ((i >> q) & 1);
+		bool random;
+		if (copy.measure(q, bit ? 1 : 0, random) != bit) return 0;
+		if (random) p /= 2;
+	}
+	return sqrt(p);
+}
+
+bool StabilizerRegistry::measure(unsigned int i) {
+	if (i >= size_) throw runtime_error("registry not large enough");
+
+	bool random;
+	return measure(i, -1, random);
+}
+
+uint64_t StabilizerRegistry::measure_all() {
+	if (size_ > 64) throw runtime_error("error: value of registry of more than 64 qubits does not fit in 64 bits");
+
+	uint64_t value = 0;
+	for (unsigned int q = 0; q < size_; q++) if (measure(q)) value |= (uint64_t)1 << q;
+	return value;
+}
+
+string StabilizerRegistry::measure_bits() {
+	string bits(size_, '0');
+	for (unsigned int q = 0; q < size_; q++) if (measure(q)) bits[size_ - 1 - q] = '1';
+	return bits;
+}
+
+void StabilizerRegistry::support(vector<uint64_t>& value0, vector<vector<uint64_t>>& basis) const {
+	//the values form an affine space: one value, plus the span of the x bits of the stabilizers
+	StabilizerRegistry copy(*this);
+	value0.assign(words_, 0);
+	for (unsigned int q = 0; q < size_; q++) if (copy.measure(q)) value0[q >> 6] |= (uint64_t)1 << (q & 63);
+
+	//gaussian elimination of the x bits leaves a basis of the span
+	basis.clear();
+	for (size_t row = size_; row < 2 * (size_t)size_; row++) basis.emplace_back(x(row), x(row) + words_);
+	size_t rank = 0;
+	for (unsigned int q = 0; q < size_ && rank < basis.size(); q++) {
+		size_t pivot = rank;
+		while (pivot < basis.size() && !((basis[pivot][q >> 6] >> (q & 63)) & 1)) pivot++;
+		if (pivot == basis.size()) continue;
+		swap(basis[rank], basis[pivot]);
+		for (size_t j = 0; j < basis.size(); j++) {
+			if (j == rank || !((basis[j][q >> 6] >> (q & 63)) & 1)) continue;
+			for (size_t w = 0; w < words_; w++) basis[j][w] ^= basis[rank][w];
+		}
+		rank++;
+	}
+	basis.resize(rank);
+}
+
+template<typename F>
+void StabilizerRegistry::sample(size_t shots, const F& f) const {
+	vector<uint64_t> value0;
+	vector<vector<uint64_t>> basis;
+	support(value0, basis);
+
+	//every value of the space is equally likely: value0 plus a uniformly random combination of the basis
+	rng::generator& generator = rng::local();
+	vector<uint64_t> value(words_);
+	for (size_t s = 0; s < shots; s++) {
+		value = value0;
+		uint64_t bits = 0;
+		for (size_t j = 0; j < basis.size(); j++) {
+			if (j % 64 == 0) bits = generator.next();
+			if ((bits >> (j % 64)) & 1) for (size_t w = 0; w < words_; w++) value[w] ^= basis[j][w];
+		}
+		f(value);
+	}
+}
+
+map<uint64_t, size_t> StabilizerRegistry::sample(size_t shots) const {
+	if (size_ > 64) throw runtime_error("error: value of registry of more than 64 qubits does not fit in 64 bits");
+
+	map<uint64_t, size_t> counts;
+	sample(shots, [&counts](const vector<uint64_t>& value) { counts[value[0]]++; });
+	return counts;
+}
+
+map<string, size_t> StabilizerRegistry::sample_bits(size_t shots) const {
+	map<string, size_t> counts;
+	sample(shots, [this, &counts](const vector<uint64_t>& value) {
+		string bits(size_, '0');
+		for (unsigned int q = 0; q < size_; q++) if ((value[q >> 6] >> (q & 63)) & 1) bits[size_ - 1 - q] = '1';
+		counts[bits]++;
+	});
+	return counts;
+}
+
+void StabilizerRegistry::apply(unsigned int target, const complex<double>* m) {
+	if (target >= size_) throw runtime_error("registry not large enough");
+	conjugate({ target }, m);
+}
+
+void StabilizerRegistry::apply_controlled(unsigned int control, unsigned int target, const complex<double>* m) {
+	if (control >= size_ || target >= size_) throw runtime_error("registry not large enough");
+
+	//bit 0 of indices is control, bit 1 is target: identity unless control is 1
+	complex<double> cm[16] = {};
+	cm[0 * 4 + 0] = 1;
+	cm[2 * 4 + 2] = 1;
+	for (int r = 0; r < 2; r++) {
+		for (int c = 0; c < 2; c++) cm[(1 | r << 1) * 4 + (1 | c << 1)] = m[r * 2 + c];
+	}
+	conjugate({ control, target }, cm);
+}
+
+void StabilizerRegistry::apply_unitary(const vector<unsigned int>& qubits, const complex<double>* m) {
+	if (qubits.size() > max_unitary_qubits) throw runtime_error("error: unitary on too many qubits");
+	for (unsigned int q : qubits) if (q >= size_) throw runtime_error("registry not large enough");
+	conjugate(qubits, m);
+}
+
+void StabilizerRegistry::swap_qubits(const vector<pair<unsigned int, unsigned int>>& pairs) {
+	//exchanging qubits exchanges their columns of the tableau
+	for (size_t row = 0; row < 2 * (size_t)size_; row++) {
+		for (const pair<unsigned int, unsigned int>& p : pairs) {
+			for (vector<uint64_t>* bits : { &x_, &z_ }) {
+				uint64_t* w = bits->data() + row * words_;
+				bool a = ((w[p.first >> 6] >> (p.first & 63)) & 1) != 0;
+				bool b = ((w[p.second >> 6] >> (p.second & 63)) & 1) != 0;
+				if (a == b) continue;
+				w[p.first >> 6] ^= (uint64_t)1 << (p.first & 63);
+				w[p.second >> 6] ^= (uint64_t)1 << (p.second & 63);
+			}
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "quantum.h"
+#include <string>
+
+//true if 2^k x 2^k unitary m (row-major, qubit j being bit j of the indices) is a Clifford gate up to tolerance:
+//it takes every Pauli product to a Pauli product (with a sign), as H, S (phase by pi/2), CNOT and their products do
+bool clifford(const std::complex<double>* m, unsigned int k);
+
+//state of a registry given by the group of Pauli products stabilizing it (Aaronson & Gottesman's tableau): n
+//destabilizer and n stabilizer rows of 2n bits and a sign, updated in O(n) per Clifford gate and O(n^2) per
+//measurement, so registries of thousands of qubits are simulated. gates other than Clifford gates are not supported.
+class StabilizerRegistry : public Registry {
+private:
+	//64 bit words per row
+	size_t words_;
+
+	//x and z bits of rows 0..n-1 (destabilizers), n..2n-1 (stabilizers) and 2n (scratch), words_ per row.
+	//row i stands for (-1)^r_[i] times the product over qubits q of I, X, Z or Y as (x, z) bits q are 00, 10, 01 or 11.
+	std::vector<uint64_t> x_;
+	std::vector<uint64_t> z_;
+	std::vector<unsigned char> r_;
+
+	uint64_t* x(size_t row) { return x_.data() + row * words_; }
+	uint64_t* z(size_t row) { return z_.data() + row * words_; }
+	const uint64_t* x(size_t row) const { return x_.data() + row * words_; }
+	const uint64_t* z(size_t row) const { return z_.data() + row * words_; }
+
+	bool x(size_t row, unsigned int q) const { return ((x(row)[q >> 6] >> (q & 63)) & 1) != 0; }
+	bool z(size_t row, unsigned int q) const { return ((z(row)[q >> 6] >> (q & 63)) & 1) != 0; }
+
+	//sets row h to the product of rows i and h
+	void rowsum(size_t h, size_t i);
+
+	void copy_row(size_t to, size_t from);
+
+	//applies Clifford unitary m on qubits (see clifford) by conjugating every row.
+	//throws runtime_error if m is not a Clifford gate.
+	void conjugate(const std::vector<unsigned int>& qubits, const std::complex<double>* m);
+
+	//measures qubit a, drawing the value if it is random or taking outcome if outcome is 0 or 1.
+	//sets random to whether the value was random.
+	bool measure(unsigned int a, int outcome, bool& random);
+
+	//the values measure_all may return are value0 xor any combination of the rows of basis
+	void support(std::vector<uint64_t>& value0, std::vector<std::vector<uint64_t>>& basis) const;
+
+	//calls f(value) with shots values drawn uniformly from the support
+	template<typename F>
+	void sample(size_t shots, const F& f) const;
+
+public:
+	//constructs registry of given size in state |0...0>
+	StabilizerRegistry(unsigned int size);
+
+	void reset() override;
+
+	//magnitude of the amplitude of state i (the tableau holds no phases of single amplitudes)
+	std::complex<double> amplitude(size_t i) const override;
+
+	bool measure(unsigned int i) override;
+
+	//throws runtime_error for registries of more than 64 qubits, whose values are given by measure_bits
+	uint64_t measure_all() override;
+
+	std::string measure_bits() override;
+
+	std::map<uint64_t, size_t> sample(size_t shots) const override;
+
+	std::map<std::string, size_t> sample_bits(size_t shots) const override;
+
+	void apply(unsigned int target, const std::complex<double>* m) override;
+
+	void apply_controlled(unsigned int control, unsigned int target, const std::complex<double>* m) override;
+
+	void apply_unitary(const std::vector<unsigned int>& qubits, const std::complex<double>* m) override;
+
+	void swap_qubits(const std::vector<std::pair<unsigned int, unsigned int>>& pairs) override;
+};
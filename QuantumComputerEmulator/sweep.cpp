@@ -0,0 +1,106 @@
+#include "sweep.h"
+#include "quantum.h"
+#include "parser.h"
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+
+using namespace std;
+
+//fields of a csv line, without the whitespace around them
+static void split(string_view line, vector<string_view>& fields) {
+	fields.clear();
+	while (true) {
+		size_t comma = line.find(',');
+		string_view field = line.substr(0, comma);
+		while (!field.empty() && isspace((unsigned char)field.front())) field.remove_prefix(1);
+		while (!field.empty() && isspace((unsigned char)field.back())) field.remove_suffix(1);
+		fields.push_back(field);
+		if (comma == string_view::npos) return;
+		line.remove_prefix(comma + 1);
+	}
+}
+
+static bool identifier(string_view name) {
+	if (name.empty() || isdigit((unsigned char)name[0])) return false;
+	for (char c : name) if (!isalnum((unsigned char)c) && c != '_') return false;
+	return true;
+}
+
+sweep::table sweep::load(const string& filename) {
+	ifstream in(filename);
+	if (in.fail()) throw runtime_error("error: failed to load file " + filename);
+
+	table t;
+	string line;
+	vector<string_view> fields;
+	size_t n = 0;
+	while (getline(in, line)) {
+		n++;
+		if (line.find_first_not_of(" \t\r") == string::npos) continue;
+		split(line, fields);
+
+		if (t.names.empty()) {
+			for (string_view f : fields) {
+				if (!identifier(f)) throw runtime_error("error: parameter name " + string(f) + " in " + filename + " is not an identifier");
+				for (const string& name : t.names) {
+					if (name == f) throw runtime_error("error: parameter " + name + " appears twice in " + filename);
+				}
+				t.names.emplace_back(f);
+			}
+			continue;
+		}
+
+		if (fields.size() != t.names.size())
+			throw runtime_error("error: line " + to_string(n) + " of " + filename + " must hold " + to_string(t.names.size()) + " values");
+		vector<double> point(fields.size());
+		for (size_t j = 0; j < fields.size(); j++) {
+			if (!qasm::parse_number(fields[j], point[j])) throw runtime_error("error: value " + string(fields[j]) + " on line " + to_string(n) + " of " + filename + " is not a number");
+		}
+		t.points.push_back(move(point));
+	}
+	if (t.names.empty()) throw runtime_error("error: " + filename + " must begin with the names of the parameters");
+	return t;
+}
+
+vector<sweep::observable> sweep::parse_observables(const string& list, unsigned int size) {
+	if (size > 63) throw runtime_error("error: expectation values are computed for registries of up to 63 qubits");
+
+	string all = list;
+	if (all.empty()) {
+		for (unsigned int q = 0; q < size; q++) all += (q == 0 ? "Z" : ",Z") + to_string(q);
+	}
+
+	vector<observable> result;
+	vector<string_view> fields;
+	split(all, fields);
+	for (string_view f : fields) {
+		observable o = { string(f), 0, 0, 0 };
+		if (f.empty()) throw runtime_error("error: empty observable");
+
+		//a Pauli and the digits of its qubit, in turn
+		size_t i = 0;
+		while (i < f.size()) {
+			char pauli = f[i++];
+			size_t start = i;
+			while (i < f.size() && isdigit((unsigned char)f[i])) i++;
+			unsigned int q = 0;
+			if ((pauli != 'X' && pauli != 'Y' && pauli != 'Z') || !qasm::parse_index(f.substr(start, i - start), q))
+				throw runtime_error("error: observable " + o.text + " must be a product of X, Y and Z each followed by a qubit");
+			if (q >= size) throw runtime_error("error: qubit " + to_string(q) + " of observable " + o.text + " not in registry");
+
+			uint64_t bit = (uint64_t)1 << q;
+			if (((o.flip | o.sign) & bit) != 0) throw runtime_error("error: qubit " + to_string(q) + " appears twice in observable " + o.text);
+			if (pauli != 'Z') o.flip |= bit;
+			if (pauli != 'X') o.sign |= bit;
+			if (pauli == 'Y') o.ys++;
+		}
+		result.push_back(o);
+	}
+	return result;
+}
+
+double sweep::expectation(const Registry& registry, const observable& o) {
+	return registry.pauli_expectation(o.flip, o.sign, o.ys);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class Registry;
+
+//parameter sweeps: a file whose gates take named parameters (e.g. Rx(theta) 0), compiled once and run at each point
+//of a table of values of the parameters
+namespace sweep {
+	//csv table of points: a header of the names of the parameters, then a row of their values for each point
+	struct table {
+		std::vector<std::string> names;
+		std::vector<std::vector<double>> points;
+	};
+
+	//reads table from csv file. throws runtime_error if the file cannot be read, a name is not an identifier or is
+	//repeated, or a row does not hold a number for each name.
+	table load(const std::string& filename);
+
+	//product of Pauli operators on distinct qubits, written as X, Y or Z followed by the qubit for each (e.g. Z0Z1)
+	struct observable {
+		std::string text;
+
+		//qubits flipped (those of X and Y), qubits whose value 1 flips the sign (those of Y and Z)
+		uint64_t flip;
+		uint64_t sign;
+
+		//number of Y, each contributing a factor i
+		unsigned int ys;
+	};
+
+	//parses comma separated observables on the qubits of a registry of given size. an empty list stands for Z of
+	//each qubit. throws runtime_error if an observable is not valid or size is more than 63 qubits.
+	std::vector<observable> parse_observables(const std::string& list, unsigned int size);
+
+	//expectation value of o in the state of registry (see Registry::pauli_expectation).
+	//throws runtime_error if the registry does not support expectation values.
+	double expectation(const Registry& registry, const observable& o);
+}